@@ -1,5 +1,6 @@
 // client.c - simple TCP client for the menu-driven server
-// Compile on Linux: gcc -o client client.c
+// Compile on Linux: gcc -o client client.c -lz
+// Usage: client [--frames] [server-ip]
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,28 +12,460 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <termios.h>
+#include <zlib.h>
 
 #define PORT 3000
 #define BUFSIZE 1024
 
-static ssize_t recv_line(int sock, char *buf, size_t bufsize) {
+#define CONN_BUFSIZE 65536
+
+// Framed protocol (--frames): a type byte, a 32-bit big-endian payload
+// length, then the payload
+#define FRAME_HEADER 5
+enum {
+    FRAME_TEXT = 'T',
+    FRAME_PROMPT = 'P',
+    FRAME_FILE = 'F',
+    FRAME_DATA = 'D',
+    FRAME_END = 'E',
+    FRAME_ERROR = 'X'
+};
+
+// First payload byte of a FRAME_PROMPT: the kind of input it waits for
+enum {
+    PROMPT_LINE = 'L',
+    PROMPT_SECRET = 'S',
+    PROMPT_LIST = 'M'
+};
+
+// Read buffer for the server connection: the socket is read in large chunks
+// and lines or raw file data are handed out from it, so the switch from
+// FILE_SIZE to the binary payload never loses bytes
+typedef struct {
+    int fd;
+    size_t start;   // next unread byte in buf
+    size_t end;     // end of buffered data
+    char buf[CONN_BUFSIZE];
+} Conn;
+
+static ssize_t conn_fill(Conn *conn) {
+    ssize_t n;
+    do {
+        n = recv(conn->fd, conn->buf, sizeof(conn->buf), 0);
+    } while (n < 0 && errno == EINTR);
+    conn->start = 0;
+    conn->end = n > 0 ? (size_t)n : 0;
+    return n;
+}
+
+static ssize_t recv_line(Conn *conn, char *buf, size_t bufsize) {
     size_t idx = 0;
     while (idx + 1 < bufsize) {
-        char c;
-        ssize_t r = recv(sock, &c, 1, 0);
-        if (r == 0) return 0; // closed
-        if (r < 0) return -1;
-        if (c == '\n') break;
-        if (c == '\r') continue;
-        buf[idx++] = c;
+        if (conn->start == conn->end) {
+            ssize_t r = conn_fill(conn);
+            if (r == 0) return 0; // closed
+            if (r < 0) return -1;
+        }
+        char *data = conn->buf + conn->start;
+        size_t avail = conn->end - conn->start;
+        char *nl = memchr(data, '\n', avail);
+        size_t take = nl ? (size_t)(nl - data) : avail;
+        if (take > bufsize - 1 - idx) {
+            take = bufsize - 1 - idx;
+            nl = NULL;
+        }
+        for (size_t i = 0; i < take; i++) {
+            if (data[i] != '\r') buf[idx++] = data[i];
+        }
+        conn->start += take;
+        if (nl) {
+            conn->start++;
+            break;
+        }
     }
     buf[idx] = '\0';
     return (ssize_t)idx;
 }
 
+// Up to len raw bytes, buffered data first; large reads bypass the buffer
+static ssize_t conn_read(Conn *conn, void *dst, size_t len) {
+    if (conn->start == conn->end) {
+        if (len >= sizeof(conn->buf)) {
+            ssize_t n;
+            do {
+                n = recv(conn->fd, dst, len, 0);
+            } while (n < 0 && errno == EINTR);
+            return n;
+        }
+        ssize_t n = conn_fill(conn);
+        if (n <= 0) return n;
+    }
+    size_t avail = conn->end - conn->start;
+    if (len > avail) len = avail;
+    memcpy(dst, conn->buf + conn->start, len);
+    conn->start += len;
+    return (ssize_t)len;
+}
+
+// Show progress at every 10% step, even when a read spans several
+static void show_progress(long received, long filesize, int *last_percent) {
+    int percent = filesize > 0 ? (int)((received * 100) / filesize) / 10 * 10 : 100;
+    if (percent != *last_percent) {
+        printf("⏳ Progress: %d%%\n", percent);
+        fflush(stdout);
+        *last_percent = percent;
+    }
+}
+
+// Inflate n compressed bytes into out (NULL discards them), adding the
+// plain bytes to *written. Returns the last inflate() result, or -1.
+static int inflate_piece(z_stream *zs, unsigned char *in, size_t n, FILE *out, long *written) {
+    static unsigned char plain[1 << 20];
+    int ret;
+    zs->next_in = in;
+    zs->avail_in = (uInt)n;
+    do {
+        zs->next_out = plain;
+        zs->avail_out = sizeof(plain);
+        ret = inflate(zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) return -1;
+        size_t have = sizeof(plain) - zs->avail_out;
+        if (out) fwrite(plain, 1, have, out);
+        *written += (long)have;
+    } while (zs->avail_out == 0);
+    return ret;
+}
+
+// Inflate a download sent as FILE_CHUNK:<n> framed pieces of one zlib
+// stream, ended by FILE_CHUNK:0, into out (NULL discards it). Returns the
+// bytes written, or -1 on error; *wire gets the compressed bytes read.
+static long receive_deflated(Conn *conn, FILE *out, long filesize, long *wire) {
+    static unsigned char in[1 << 18];
+    char line[BUFSIZE];
+    long written = 0;
+    int last_percent = -1;
+    int ret = Z_OK;
+    int failed = 0;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) return -1;
+    *wire = 0;
+
+    while (!failed) {
+        if (recv_line(conn, line, sizeof(line)) <= 0 || strncmp(line, "FILE_CHUNK:", 11) != 0) {
+            failed = 1;
+            break;
+        }
+        long remaining = atol(line + 11);
+        if (remaining <= 0) break;
+
+        while (!failed && remaining > 0) {
+            size_t want = remaining > (long)sizeof(in) ? sizeof(in) : (size_t)remaining;
+            ssize_t n = conn_read(conn, in, want);
+            if (n <= 0) {
+                failed = 1;
+                break;
+            }
+            remaining -= n;
+            *wire += n;
+
+            ret = inflate_piece(&zs, in, (size_t)n, out, &written);
+            if (ret < 0) {
+                failed = 1;
+                break;
+            }
+            if (out) show_progress(written, filesize, &last_percent);
+        }
+    }
+
+    inflateEnd(&zs);
+    return failed || ret != Z_STREAM_END ? -1 : written;
+}
+
+static int send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Header of a frame: type byte and big-endian payload length
+static void frame_header(unsigned char *hdr, int type, size_t len) {
+    hdr[0] = (unsigned char)type;
+    hdr[1] = (unsigned char)(len >> 24);
+    hdr[2] = (unsigned char)(len >> 16);
+    hdr[3] = (unsigned char)(len >> 8);
+    hdr[4] = (unsigned char)len;
+}
+
+// Append one line to the upload chunk, sending the chunk when it is full.
+// In frames mode the line goes out as its own FRAME_TEXT.
+static int queue_line(int fd, char *chunk, size_t size, size_t *used, char *line, int framed) {
+    line[strcspn(line, "\r\n")] = '\0';
+    size_t len = strlen(line);
+    size_t header = framed ? FRAME_HEADER : 0;
+    if (len + 1 + header > size) len = size - 1 - header;
+    if (*used + header + len + 1 > size) {
+        if (send_all(fd, chunk, *used) != 0) return -1;
+        *used = 0;
+    }
+    if (framed) frame_header((unsigned char *)chunk + *used, FRAME_TEXT, len + 1);
+    memcpy(chunk + *used + header, line, len);
+    chunk[*used + header + len] = '\n';
+    *used += header + len + 1;
+    return 0;
+}
+
+// Batch upload: MSISDNs typed one per line, or "@file" to send a file of
+// them, until END (or end of input). Lines are sent in large chunks.
+static int upload_batch(int fd, int framed) {
+    static char chunk[CONN_BUFSIZE];
+    size_t used = 0;
+    char input[256];
+
+    while (fgets(input, sizeof(input), stdin) != NULL) {
+        input[strcspn(input, "\r\n")] = '\0';
+        if (strcmp(input, "END") == 0) break;
+
+        if (input[0] != '@') {
+            if (queue_line(fd, chunk, sizeof(chunk), &used, input, framed) != 0) return -1;
+            continue;
+        }
+        FILE *list = fopen(input + 1, "r");
+        if (!list) {
+            printf("Cannot open %s: %s\n", input + 1, strerror(errno));
+            continue;
+        }
+        char line[256];
+        int rc = 0;
+        while (rc == 0 && fgets(line, sizeof(line), list) != NULL)
+            rc = queue_line(fd, chunk, sizeof(chunk), &used, line, framed);
+        fclose(list);
+        if (rc != 0) return -1;
+    }
+
+    char end[] = "END";
+    if (queue_line(fd, chunk, sizeof(chunk), &used, end, framed) != 0) return -1;
+    return send_all(fd, chunk, used);
+}
+
+// Answer to a prompt from stdin, without its newline; a secret (password)
+// is read without echo. Returns -1 at end of input.
+static int read_input(int secret, char *input, size_t size) {
+    input[0] = '\0';
+    if (secret) {
+        // Read password without echo (POSIX - works with PuTTY)
+        struct termios oldt, newt;
+        if (tcgetattr(fileno(stdin), &oldt) == 0) {
+            newt = oldt;
+            newt.c_lflag &= ~(ECHO);
+            tcsetattr(fileno(stdin), TCSANOW, &newt);
+            char *got = fgets(input, (int)size, stdin);
+            tcsetattr(fileno(stdin), TCSANOW, &oldt);
+            if (got == NULL) return -1;
+        } else if (fgets(input, (int)size, stdin) == NULL) {
+            return -1;
+        }
+        // print a newline to move prompt (since echo was off)
+        printf("\n");
+    } else if (fgets(input, (int)size, stdin) == NULL) {
+        return -1;
+    }
+    // trim newline
+    size_t len = strlen(input);
+    if (len > 0 && input[len-1] == '\n') input[len-1] = '\0';
+    return 0;
+}
+
+/* ---- Frames mode ---- */
+
+// Exactly len bytes, or -1 if the connection ends first
+static int read_exact(Conn *conn, void *dst, size_t len) {
+    char *p = (char *)dst;
+    while (len > 0) {
+        ssize_t n = conn_read(conn, p, len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int recv_frame_header(Conn *conn, int *type, size_t *len) {
+    unsigned char hdr[FRAME_HEADER];
+    if (read_exact(conn, hdr, sizeof(hdr)) != 0) return -1;
+    *type = hdr[0];
+    *len = (size_t)hdr[1] << 24 | (size_t)hdr[2] << 16 | (size_t)hdr[3] << 8 | hdr[4];
+    return 0;
+}
+
+// Pass len payload bytes to out (NULL skips them unread by anyone)
+static int copy_payload(Conn *conn, size_t len, FILE *out) {
+    static char chunk[1 << 20];
+    while (len > 0) {
+        size_t want = len > sizeof(chunk) ? sizeof(chunk) : len;
+        ssize_t n = conn_read(conn, chunk, want);
+        if (n <= 0) return -1;
+        if (out) fwrite(chunk, 1, (size_t)n, out);
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// A short payload as a string; the part beyond size is skipped
+static int read_payload(Conn *conn, size_t len, char *buf, size_t size) {
+    size_t keep = len < size - 1 ? len : size - 1;
+    if (read_exact(conn, buf, keep) != 0 || copy_payload(conn, len - keep, NULL) != 0) return -1;
+    buf[keep] = '\0';
+    return 0;
+}
+
+static int send_frame(int fd, int type, const char *data, size_t len) {
+    char frame[FRAME_HEADER + 512];
+    if (len > sizeof(frame) - FRAME_HEADER) len = sizeof(frame) - FRAME_HEADER;
+    frame_header((unsigned char *)frame, type, len);
+    memcpy(frame + FRAME_HEADER, data, len);
+    return send_all(fd, frame, FRAME_HEADER + len);
+}
+
+// A download: FRAME_FILE "<name>\n<size>\n<encoding>", then FRAME_DATA
+// frames until FRAME_END. If the file cannot be created the data frames are
+// skipped by their length.
+static int receive_file_frames(Conn *conn, size_t info_len) {
+    static unsigned char in[1 << 18];
+    char info[BUFSIZE];
+    if (read_payload(conn, info_len, info, sizeof(info)) != 0) return -1;
+
+    char *size_line = strchr(info, '\n');
+    char *encoding = size_line ? strchr(size_line + 1, '\n') : NULL;
+    if (!encoding) {
+        printf("❌ Malformed file header\n");
+        return -1;
+    }
+    *size_line++ = '\0';
+    *encoding++ = '\0';
+    long filesize = atol(size_line);
+    int deflated = strcmp(encoding, "deflate") == 0;
+    printf("📥 Receiving file: %s\n", info);
+    printf("📊 File size: %ld bytes (%.2f MB)\n", filesize, (double)filesize / (1024.0 * 1024.0));
+    fflush(stdout);
+
+    FILE *outfile = fopen(info, "wb");
+    if (!outfile) printf("❌ Error: Cannot create file %s\n", info);
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflated && inflateInit(&zs) != Z_OK) deflated = -1;
+
+    long received = 0, wire = 0;
+    int last_percent = -1, failed = deflated < 0, type = 0;
+    size_t len;
+    while (recv_frame_header(conn, &type, &len) == 0 && type != FRAME_END) {
+        if (type != FRAME_DATA || !outfile || failed) {
+            if (copy_payload(conn, len, NULL) != 0) break;
+            continue;
+        }
+        wire += (long)len;
+        if (!deflated) {
+            if (copy_payload(conn, len, outfile) != 0) break;
+            received += (long)len;
+        }
+        while (deflated && len > 0) {
+            size_t want = len > sizeof(in) ? sizeof(in) : len;
+            if (read_exact(conn, in, want) != 0 || inflate_piece(&zs, in, want, outfile, &received) < 0) {
+                failed = 1;
+                copy_payload(conn, len - want, NULL);
+                break;
+            }
+            len -= want;
+        }
+        show_progress(received, filesize, &last_percent);
+    }
+    if (deflated > 0) inflateEnd(&zs);
+    if (!outfile) return type == FRAME_END ? 0 : -1;
+    fclose(outfile);
+
+    if (received == filesize && type == FRAME_END) {
+        if (deflated && wire > 0)
+            printf("🗜️ Compressed: %ld bytes on the wire (%.1fx smaller)\n",
+                   wire, (double)received / (double)wire);
+        printf("✅ File saved successfully: %s\n", info);
+        printf("✨ Transfer completed!\n\n");
+    } else {
+        printf("⚠️ File transfer incomplete: received %ld of %ld bytes\n", received, filesize);
+    }
+    fflush(stdout);
+    return type == FRAME_END ? 0 : -1;
+}
+
+// Typed frames replace the text markers: prompts, errors and downloads are
+// recognized by their type, never by their wording
+static void run_frames(Conn *conn, int sockfd) {
+    char text[BUFSIZE];
+    int type;
+    size_t len;
+    while (1) {
+        if (recv_frame_header(conn, &type, &len) != 0) {
+            printf("Server closed connection.\n");
+            return;
+        }
+        switch (type) {
+        case FRAME_TEXT:
+            if (copy_payload(conn, len, stdout) != 0) return;
+            break;
+        case FRAME_ERROR:
+            if (read_payload(conn, len, text, sizeof(text)) != 0) return;
+            printf("❌ %s\n", text);
+            break;
+        case FRAME_FILE:
+            if (receive_file_frames(conn, len) != 0) return;
+            break;
+        case FRAME_PROMPT: {
+            if (len == 0 || read_payload(conn, len, text, sizeof(text)) != 0) return;
+            int kind = (unsigned char)text[0];
+            printf("%s\n", text + 1);
+            fflush(stdout);
+            // batch search: the server waits for the whole list
+            if (kind == PROMPT_LIST) {
+                printf("(one MSISDN per line, @file to upload a list, END when done)\n");
+                fflush(stdout);
+                if (upload_batch(sockfd, 1) != 0) return;
+                break;
+            }
+            char input[256];
+            if (read_input(kind == PROMPT_SECRET, input, sizeof(input)) != 0) {
+                printf("Input closed. Disconnecting.\n");
+                return;
+            }
+            size_t n = strlen(input);
+            input[n++] = '\n';
+            if (send_frame(sockfd, FRAME_TEXT, input, n) != 0) {
+                perror("send");
+                return;
+            }
+            break;
+        }
+        default:
+            // Unknown, or data outside a download: skip it by its length
+            if (copy_payload(conn, len, NULL) != 0) return;
+            break;
+        }
+        fflush(stdout);
+    }
+}
+
 int main(int argc, char **argv) {
     const char *server_ip = "127.0.0.1";
-    if (argc >= 2) server_ip = argv[1];
+    int frames = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0) frames = 1;
+        else server_ip = argv[i];
+    }
 
     int sockfd;
     struct sockaddr_in serv_addr;
@@ -59,10 +492,31 @@ int main(int argc, char **argv) {
 
     printf("Connected to %s:%d\n", server_ip, PORT);
 
+    // Ask for compressed downloads, and for frames with --frames
+    const char *caps = frames ? "CLIENT_CAPS: deflate frames\n" : "CLIENT_CAPS: deflate\n";
+    if (send_all(sockfd, caps, strlen(caps)) != 0) {
+        perror("send");
+        return 1;
+    }
+
+    static Conn conn;
+    conn.fd = sockfd;
+
+    if (frames) {
+        // The menu sent before the switch is repeated as frames
+        ssize_t r;
+        while ((r = recv_line(&conn, buf, sizeof(buf))) > 0 && strcmp(buf, "FRAMES_ON") != 0)
+            ;
+        if (r > 0) run_frames(&conn, sockfd);
+        else printf("Server closed connection.\n");
+        close(sockfd);
+        return 0;
+    }
+
     // Read loop: server will send lines; when a prompt 'Enter choice' appears,
     // read user input and send it.
     while (1) {
-        ssize_t r = recv_line(sockfd, buf, sizeof(buf));
+        ssize_t r = recv_line(&conn, buf, sizeof(buf));
         if (r == 0) {
             printf("Server closed connection.\n");
             break;
@@ -73,12 +527,18 @@ int main(int argc, char **argv) {
         
         // Check for file transfer marker
         if (strncmp(buf, "FILE_TRANSFER_START:", 20) == 0) {
-            char *filename = buf + 20; // Get filename after marker
+            char filename[BUFSIZE];
+            snprintf(filename, sizeof(filename), "%s", buf + 20); // Get filename after marker
             printf("📥 Receiving file: %s\n", filename);
             fflush(stdout);
             
-            // Read file size
-            r = recv_line(sockfd, buf, sizeof(buf));
+            // Optional encoding, then the file size
+            int deflated = 0;
+            r = recv_line(&conn, buf, sizeof(buf));
+            if (r > 0 && strcmp(buf, "FILE_ENCODING:deflate") == 0) {
+                deflated = 1;
+                r = recv_line(&conn, buf, sizeof(buf));
+            }
             if (r <= 0 || strncmp(buf, "FILE_SIZE:", 10) != 0) {
                 printf("❌ Error receiving file size\n");
                 break;
@@ -93,11 +553,16 @@ int main(int argc, char **argv) {
             if (!outfile) {
                 printf("❌ Error: Cannot create file %s\n", filename);
                 // Read and discard the data
-                char discard[8192];
+                long wire;
+                if (deflated) {
+                    receive_deflated(&conn, NULL, filesize, &wire);
+                    continue;
+                }
+                char discard[CONN_BUFSIZE];
                 long remaining = filesize;
                 while (remaining > 0) {
-                    size_t to_read = (remaining > sizeof(discard)) ? sizeof(discard) : remaining;
-                    ssize_t n = recv(sockfd, discard, to_read, 0);
+                    size_t to_read = (remaining > (long)sizeof(discard)) ? sizeof(discard) : (size_t)remaining;
+                    ssize_t n = conn_read(&conn, discard, to_read);
                     if (n <= 0) break;
                     remaining -= n;
                 }
@@ -106,30 +571,33 @@ int main(int argc, char **argv) {
             
             // Receive file data
             long received = 0;
-            char filebuf[8192];
+            static char filebuf[1 << 20];
             int last_percent = -1;
             
-            while (received < filesize) {
+            if (deflated) {
+                long wire = 0;
+                received = receive_deflated(&conn, outfile, filesize, &wire);
+                if (received < 0) {
+                    printf("\n❌ Error receiving file data\n");
+                    received = 0;
+                } else if (wire > 0) {
+                    printf("🗜️ Compressed: %ld bytes on the wire (%.1fx smaller)\n",
+                           wire, (double)received / (double)wire);
+                }
+            }
+            while (!deflated && received < filesize) {
                 size_t to_receive = filesize - received;
                 if (to_receive > sizeof(filebuf)) to_receive = sizeof(filebuf);
                 
-                ssize_t n = recv(sockfd, filebuf, to_receive, 0);
+                ssize_t n = conn_read(&conn, filebuf, to_receive);
                 if (n <= 0) {
                     printf("\n❌ Error receiving file data\n");
-                    fclose(outfile);
                     break;
                 }
                 
                 fwrite(filebuf, 1, n, outfile);
                 received += n;
-                
-                // Show progress
-                int percent = (int)((received * 100) / filesize);
-                if (percent != last_percent && percent % 10 == 0) {
-                    printf("⏳ Progress: %d%%\n", percent);
-                    fflush(stdout);
-                    last_percent = percent;
-                }
+                show_progress(received, filesize, &last_percent);
             }
             
             fclose(outfile);
@@ -142,7 +610,7 @@ int main(int argc, char **argv) {
             fflush(stdout);
             
             // Read completion marker
-            r = recv_line(sockfd, buf, sizeof(buf));
+            r = recv_line(&conn, buf, sizeof(buf));
             if (r > 0 && strcmp(buf, "FILE_TRANSFER_COMPLETE") == 0) {
                 printf("✨ Transfer completed!\n\n");
             }
@@ -153,51 +621,29 @@ int main(int argc, char **argv) {
         // print server line
         printf("%s\n", buf);
         fflush(stdout);
+        // batch search: the server waits for the whole list
+        if (strstr(buf, "then END to finish") != NULL) {
+            printf("(one MSISDN per line, @file to upload a list, END when done)\n");
+            fflush(stdout);
+            if (upload_batch(sockfd, 0) != 0) {
+                perror("send");
+                break;
+            }
+            continue;
+        }
         // if the server asks for input (choice or credentials)
             if (strstr(buf, "Enter choice") != NULL || 
                 strstr(buf, "Enter email") != NULL || 
                 strstr(buf, "Enter password") != NULL ||
                 strstr(buf, "Enter MSISDN") != NULL ||
                 strstr(buf, "Enter operator name") != NULL ||
+                strstr(buf, "Enter job ID") != NULL ||
+                strstr(buf, "Enter session token") != NULL ||
                 strstr(buf, "Press Enter") != NULL) {
-                // read from stdin; if server asked for password, disable echo
                 char input[256];
-                input[0] = '\0';
-                if (strstr(buf, "Enter password") != NULL) {
-                    // Read password without echo (POSIX - works with PuTTY)
-                    struct termios oldt, newt;
-                    if (tcgetattr(fileno(stdin), &oldt) == 0) {
-                        newt = oldt;
-                        newt.c_lflag &= ~(ECHO);
-                        tcsetattr(fileno(stdin), TCSANOW, &newt);
-                        if (fgets(input, sizeof(input), stdin) == NULL) {
-                            // EOF
-                            tcsetattr(fileno(stdin), TCSANOW, &oldt);
-                            printf("Input closed. Disconnecting.\n");
-                            break;
-                        }
-                        tcsetattr(fileno(stdin), TCSANOW, &oldt);
-                    } else {
-                        // fallback to normal fgets
-                        if (fgets(input, sizeof(input), stdin) == NULL) {
-                            printf("Input closed. Disconnecting.\n");
-                            break;
-                        }
-                    }
-                    // trim newline if present
-                    size_t lenp = strlen(input);
-                    if (lenp > 0 && input[lenp-1] == '\n') input[lenp-1] = '\0';
-                    // print a newline to move prompt (since echo was off)
-                    printf("\n");
-                } else {
-                    if (fgets(input, sizeof(input), stdin) == NULL) {
-                        // EOF on stdin; close
-                        printf("Input closed. Disconnecting.\n");
-                        break;
-                    }
-                    // trim newline
-                    size_t len = strlen(input);
-                    if (len > 0 && input[len-1] == '\n') input[len-1] = '\0';
+                if (read_input(strstr(buf, "Enter password") != NULL, input, sizeof(input)) != 0) {
+                    printf("Input closed. Disconnecting.\n");
+                    break;
                 }
 
                 // send with newline
@@ -42,10 +42,101 @@ int is_valid_password(const char *password) {
     return (has_upper && has_lower && has_digit && has_special);
 }
  
-// 👇 NEW FUNCTION: Check if user already exists
-int user_exists(const char *email) {
+/* ==== User Directory ==== */
+ 
+// Registered users are loaded from USER_FILE once and kept in a hash map
+// keyed by email; the file is only appended to afterwards. Lookups share
+// a read lock, signups take the write lock to check and append atomically.
+typedef struct UserEntry {
+    char email[EMAIL_MAX];
+    char password[PASS_MAX];
+    unsigned long hash;
+    struct UserEntry *next;
+} UserEntry;
+ 
+static pthread_rwlock_t users_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_once_t users_once = PTHREAD_ONCE_INIT;
+static UserEntry **user_buckets = NULL;
+static size_t user_bucket_count = 0;
+static size_t user_count = 0;
+ 
+static unsigned long hash_email(const char *email) {
+    unsigned long h = 2166136261UL;
+    for (const unsigned char *p = (const unsigned char *)email; *p; p++)
+        h = (h ^ *p) * 16777619UL;
+    return h;
+}
+ 
+// Caller holds users_lock (or is loading)
+static UserEntry *find_user(const char *email) {
+    if (!user_buckets) return NULL;
+    unsigned long h = hash_email(email);
+    for (UserEntry *u = user_buckets[h & (user_bucket_count - 1)]; u; u = u->next) {
+        if (u->hash == h && strcmp(u->email, email) == 0) return u;
+    }
+    return NULL;
+}
+ 
+static int grow_buckets(void) {
+    size_t count = user_bucket_count ? user_bucket_count * 2 : USER_BUCKETS_MIN;
+    UserEntry **buckets = (UserEntry **)calloc(count, sizeof(UserEntry *));
+    if (!buckets) return -1;
+ 
+    for (size_t i = 0; i < user_bucket_count; i++) {
+        UserEntry *u = user_buckets[i];
+        while (u) {
+            UserEntry *next = u->next;
+            u->next = buckets[u->hash & (count - 1)];
+            buckets[u->hash & (count - 1)] = u;
+            u = next;
+        }
+    }
+    free(user_buckets);
+    user_buckets = buckets;
+    user_bucket_count = count;
+    return 0;
+}
+ 
+// Entry for a decoded email and password, not yet in the table
+static UserEntry *new_user(const char *email, const char *password) {
+    UserEntry *u = (UserEntry *)malloc(sizeof(UserEntry));
+    if (!u) return NULL;
+    snprintf(u->email, sizeof(u->email), "%s", email);
+    snprintf(u->password, sizeof(u->password), "%s", password);
+    u->hash = hash_email(u->email);
+    u->next = NULL;
+    return u;
+}
+ 
+// Make an entry visible; the buckets must exist
+static void link_user(UserEntry *u) {
+    u->next = user_buckets[u->hash & (user_bucket_count - 1)];
+    user_buckets[u->hash & (user_bucket_count - 1)] = u;
+    user_count++;
+}
+ 
+// Keep chains short; a failed grow only costs lookup speed
+static void reserve_user(void) {
+    if (user_count >= user_bucket_count) grow_buckets();
+}
+ 
+// Add a decoded entry; the first one of an email wins, as in the old scan
+static int insert_user(const char *email, const char *password) {
+    if (find_user(email)) return -1;
+    reserve_user();
+    if (!user_buckets) return 0;
+ 
+    UserEntry *u = new_user(email, password);
+    if (!u) return 0;
+    link_user(u);
+    return 1;
+}
+ 
+// Read every stored credential once, decoding it as the file scan did
+static void load_users(void) {
+    grow_buckets();
     FILE *file = fopen(USER_FILE, "r");
-    if (!file) return 0; // If no file yet, no users exist
+    if (!file) return; // If no file yet, no users exist
  
     char line[256];
     while (fgets(line, sizeof(line), file)) {
@@ -56,28 +147,53 @@ int user_exists(const char *email) {
         *sep = '\0';
  
         char enc_email[EMAIL_MAX];
+        char enc_pass[PASS_MAX];
         strncpy(enc_email, line, EMAIL_MAX - 1);
+        strncpy(enc_pass, sep + 1, PASS_MAX - 1);
         enc_email[EMAIL_MAX - 1] = '\0';
+        enc_pass[PASS_MAX - 1] = '\0';
  
         encrypt_decrypt(enc_email);
- 
-        if (strcmp(enc_email, email) == 0) {
-            fclose(file);
-            return 1;  // ✅ user already exists
-        }
+        encrypt_decrypt(enc_pass);
+        insert_user(enc_email, enc_pass);
     }
- 
     fclose(file);
-    return 0; // not found
+}
+ 
+// Check if user already exists
+int user_exists(const char *email) {
+    pthread_once(&users_once, load_users);
+    pthread_rwlock_rdlock(&users_lock);
+    int found = find_user(email) != NULL;
+    pthread_rwlock_unlock(&users_lock);
+    return found;
 }
  
 // Save encrypted user credentials (after checking existence)
 int save_user(const char *email, const char *password) {
+    pthread_once(&users_once, load_users);
+    pthread_rwlock_wrlock(&users_lock);
+ 
     // check if already exists
-    if (user_exists(email)) return -1;  // -1 = duplicate
+    if (find_user(email)) {
+        pthread_rwlock_unlock(&users_lock);
+        return -1;  // -1 = duplicate
+    }
+ 
+    // Allocate before the append, so a failed call leaves nothing on disk
+    reserve_user();
+    UserEntry *u = user_buckets ? new_user(email, password) : NULL;
+    if (!u) {
+        pthread_rwlock_unlock(&users_lock);
+        return 0;
+    }
  
     FILE *file = fopen(USER_FILE, "a");
-    if (!file) return 0;
+    if (!file) {
+        free(u);
+        pthread_rwlock_unlock(&users_lock);
+        return 0;
+    }
  
     char enc_email[EMAIL_MAX];
     char enc_pass[PASS_MAX];
@@ -89,40 +205,21 @@ int save_user(const char *email, const char *password) {
     encrypt_decrypt(enc_email);
     encrypt_decrypt(enc_pass);
  
-    fprintf(file, "%s|%s\n", enc_email, enc_pass);
-    fclose(file);
-    return 1;  // success
+    // Persist first; the user only becomes visible once it is on disk
+    int written = fprintf(file, "%s|%s\n", enc_email, enc_pass) > 0;
+    if (fclose(file) != 0) written = 0;
+    if (written) link_user(u);
+    else free(u);
+    pthread_rwlock_unlock(&users_lock);
+    return written;  // 1 = success
 }
  
-// Verify credentials by decrypting stored values
+// Verify credentials against the stored (decoded) values
 int verify_user(const char *email, const char *password) {
-    FILE *file = fopen(USER_FILE, "r");
-    if (!file) return 0;
- 
-    char line[256];
-    while (fgets(line, sizeof(line), file)) {
-        char *nl = strchr(line, '\n');
-        if (nl) *nl = '\0';
-        char *sep = strchr(line, '|');
-        if (!sep) continue;
-        *sep = '\0';
- 
-        char enc_email[EMAIL_MAX];
-        char enc_pass[PASS_MAX];
-        strncpy(enc_email, line, EMAIL_MAX - 1);
-        strncpy(enc_pass, sep + 1, PASS_MAX - 1);
-        enc_email[EMAIL_MAX - 1] = '\0';
-        enc_pass[PASS_MAX - 1] = '\0';
- 
-        encrypt_decrypt(enc_email);
-        encrypt_decrypt(enc_pass);
- 
-        if (strcmp(enc_email, email) == 0 && strcmp(enc_pass, password) == 0) {
-            fclose(file);
-            return 1;
-        }
-    }
- 
-    fclose(file);
-    return 0;
-}
\ No newline at end of file
+    pthread_once(&users_once, load_users);
+    pthread_rwlock_rdlock(&users_lock);
+    UserEntry *u = find_user(email);
+    int ok = u && strcmp(u->password, password) == 0;
+    pthread_rwlock_unlock(&users_lock);
+    return ok;
+}
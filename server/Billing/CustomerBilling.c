@@ -4,140 +4,291 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include "../Header/CustBillProcess.h"
+#include "../Header/transfer.h"
 
-#define BUFSIZE 1024
-
-// Send all helper for socket - ensures complete data transmission
-static int sendall_fd(int sock, const char *buf, size_t len) {
-    size_t total = 0;
-    int retry_count = 0;
-    const int MAX_RETRIES = 3;
+// Send the customer block starting at the current position of file: the
+// "Customer ID" line and the 12 lines after it
+static void send_customer_block(Conn *conn, FILE *file, char *line, size_t size) {
+    line[strcspn(line, "\r\n")] = 0; // remove newline
+    send_line(conn, line);
     
-    while (total < len) {
-        ssize_t n = send(sock, buf + total, len - total, 0);
-        
-        if (n > 0) {
-            total += n;
-            retry_count = 0; // Reset retry count on success
-        } else if (n == 0) {
-            // Connection closed
-            return -1;
-        } else {
-            // Error occurred
-            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
-                // Temporary error - retry
-                retry_count++;
-                if (retry_count > MAX_RETRIES) {
-                    return -1;
-                }
-                usleep(1000); // Wait 1ms before retry
-                continue;
-            }
-            // Permanent error
-            return -1;
+    for (int i = 0; i < 12; i++) {
+        if (fgets(line, (int)size, file)) {
+            line[strcspn(line, "\r\n")] = 0;
+            send_line(conn, line);
         }
     }
-    return 0;
 }
 
-// Send a line with newline appended
-static int send_line_fd(int sock, const char *s) {
-    char tmp[BUFSIZE];
-    int len = snprintf(tmp, sizeof(tmp), "%s\n", s);
-    if (len >= BUFSIZE) {
-        // Message truncated, but still try to send
-        len = BUFSIZE - 1;
+// Open the CB.txt.idx sidecar of the report open as file, if it describes
+// exactly that report. Returns the index fd positioned after its header,
+// or -1 when the index is missing, stale or wrong.
+static int open_msisdn_index(FILE *file, const char *filename, CBIndexHeader *hdr) {
+    char path[512];
+    struct stat st;
+    if (snprintf(path, sizeof(path), "%s%s", filename, CB_INDEX_SUFFIX) >= (int)sizeof(path) ||
+        fstat(fileno(file), &st) != 0)
+        return -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat ist;
+    if (fstat(fd, &ist) != 0 || read(fd, hdr, sizeof(*hdr)) != (ssize_t)sizeof(*hdr) ||
+        memcmp(hdr->magic, CB_INDEX_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != CB_INDEX_VERSION ||
+        hdr->reportSize != (uint64_t)st.st_size || hdr->reportIno != (uint64_t)st.st_ino ||
+        hdr->reportMtimeSec != (int64_t)st.st_mtim.tv_sec ||
+        hdr->reportMtimeNsec != (int64_t)st.st_mtim.tv_nsec ||
+        hdr->count > ((uint64_t)ist.st_size - sizeof(*hdr)) / sizeof(CBIndexEntry)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Look msisdn up in the CB.txt.idx sidecar. Returns 1 if the record was
+// sent, 0 if the index says there is no such customer, and -1 when the
+// index is missing, stale or wrong and the report has to be scanned.
+static int search_msisdn_indexed(Conn *conn, FILE *file, const char *filename, long msisdn) {
+    CBIndexHeader hdr;
+    int fd = open_msisdn_index(file, filename, &hdr);
+    if (fd < 0) return -1;
+
+    // Binary search straight on the file: O(log n) small reads
+    uint64_t lo = 0, hi = hdr.count;
+    CBIndexEntry entry;
+    int found = 0;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        off_t pos = (off_t)(sizeof(hdr) + mid * sizeof(CBIndexEntry));
+        if (pread(fd, &entry, sizeof(entry), pos) != (ssize_t)sizeof(entry)) {
+            close(fd);
+            return -1;
+        }
+        if (entry.msisdn == msisdn) {
+            found = 1;
+            break;
+        }
+        if (entry.msisdn < msisdn) lo = mid + 1;
+        else hi = mid;
+    }
+    close(fd);
+    if (!found) return 0;
+
+    // Trust the offset only if it lands on this customer's record
+    char line[1024];
+    long current_msisdn;
+    if (fseeko(file, (off_t)entry.offset, SEEK_SET) != 0 ||
+        !fgets(line, sizeof(line), file) ||
+        sscanf(line, "Customer ID: %ld", &current_msisdn) != 1 ||
+        current_msisdn != msisdn) {
+        rewind(file);
+        return -1;
     }
-    return sendall_fd(sock, tmp, len);
+    send_customer_block(conn, file, line, sizeof(line));
+    return 1;
 }
 
 // Search for a customer by MSISDN and send results to client
-void search_msisdn(int client_fd, const char *filename, long msisdn) {
+void search_msisdn(Conn *conn, const char *filename, long msisdn) {
     FILE *file = fopen(filename, "r");
     char line[1024];
     int found = 0;
     
     if (!file) {
-        char errMsg[256];
-        snprintf(errMsg, sizeof(errMsg), "Error opening file: %s", strerror(errno));
-        send_line_fd(client_fd, errMsg);
-        send_line_fd(client_fd, "Note: Please process the CDR data first (option 1 from secondary menu).");
+        send_error(conn, "Error opening file: %s", strerror(errno));
+        send_line(conn, "Note: Please process the CDR data first (option 1 from secondary menu).");
         return;
     }
 
-    while (fgets(line, sizeof(line), file)) {
+    found = search_msisdn_indexed(conn, file, filename, msisdn);
+    while (found < 0 && fgets(line, sizeof(line), file)) {
         // Look for line starting with "Customer ID: "
         if (strstr(line, "Customer ID: ") != NULL) {
             long current_msisdn;
             if (sscanf(line, "Customer ID: %ld", &current_msisdn) == 1) {
                 if (current_msisdn == msisdn) {
                     found = 1;
-                    // Send this line and next 11 lines for complete customer info
-                    line[strcspn(line, "\r\n")] = 0; // remove newline
-                    send_line_fd(client_fd, line);
-                    
-                    for (int i = 0; i < 11; i++) {
-                        if (fgets(line, sizeof(line), file)) {
-                            line[strcspn(line, "\r\n")] = 0;
-                            send_line_fd(client_fd, line);
-                        }
-                    }
+                    send_customer_block(conn, file, line, sizeof(line));
                     break;
                 }
             }
         }
     }
 
-    if (!found) {
-        char notFoundMsg[256];
-        snprintf(notFoundMsg, sizeof(notFoundMsg), "Customer with MSISDN %ld not found.", msisdn);
-        send_line_fd(client_fd, notFoundMsg);
+    if (found <= 0) {
+        send_linef(conn, "Customer with MSISDN %ld not found.", msisdn);
     }
 
     fclose(file);
 }
 
+// Search the resident aggregates of the latest run; the reply matches the
+// CB.txt search above. Returns 1 if the customer was found.
+int search_msisdn_table(Conn *conn, const CustomerTable *table,
+                        const OpTable *operators, long msisdn) {
+    const Customer *cust = findCustomer(table, msisdn);
+    if (!cust) {
+        send_linef(conn, "Customer with MSISDN %ld not found.", msisdn);
+        return 0;
+    }
 
-void display_customer_billing_file(int client_fd, const char *filename) {
-    FILE *file = fopen(filename, "rb");
+    char block[CUST_RECORD_MAX];
+    int len = formatCustomerRecord(block, sizeof(block), cust,
+                                   operator_name_at(operators, cust->opIndex));
+    if (len >= (int)sizeof(block)) len = (int)sizeof(block) - 1;
 
-    if (!file) {
-        char msg[512];
-        snprintf(msg, sizeof(msg), "Error opening file: %s", strerror(errno));
-        send_line_fd(client_fd, msg);
-        snprintf(msg, sizeof(msg), "Note: Please process the CDR data first using option 1 from the main menu.");
-        send_line_fd(client_fd, msg);
-        return;
+    // Everything up to the separator line
+    char *sep = strstr(block, "\n----");
+    if (sep) len = (int)(sep - block) + 1;
+    conn_write(conn, block, (size_t)len);
+    return 1;
+}
+
+/* ==== Batch Search ==== */
+
+// A requested MSISDN and where its block starts in CB.txt (-1: not found)
+typedef struct {
+    long msisdn;
+    off_t offset;
+} BatchSlot;
+
+static int compare_slot(const void *a, const void *b) {
+    long x = ((const BatchSlot *)a)->msisdn, y = ((const BatchSlot *)b)->msisdn;
+    return (x > y) - (x < y);
+}
+
+// Fill in the offsets of the sorted slots from the index; -1 if unusable
+static int locate_indexed(FILE *file, const char *filename, BatchSlot *slots, size_t count) {
+    CBIndexHeader hdr;
+    int fd = open_msisdn_index(file, filename, &hdr);
+    if (fd < 0) return -1;
+
+    // Both lists are sorted: merge them in one sequential read of the index
+    CBIndexEntry entries[512];
+    size_t next = 0;
+    uint64_t done = 0;
+    while (done < hdr.count && next < count) {
+        size_t want = sizeof(entries) / sizeof(entries[0]);
+        if (hdr.count - done < want) want = (size_t)(hdr.count - done);
+        if (read(fd, entries, want * sizeof(CBIndexEntry)) != (ssize_t)(want * sizeof(CBIndexEntry))) {
+            close(fd);
+            return -1;
+        }
+        for (size_t i = 0; i < want && next < count; i++) {
+            while (next < count && slots[next].msisdn < entries[i].msisdn) next++;
+            while (next < count && slots[next].msisdn == entries[i].msisdn)
+                slots[next++].offset = (off_t)entries[i].offset;
+        }
+        done += want;
     }
-    
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long filesize = ftell(file);
+    close(fd);
+    return 0;
+}
+
+// Fill in the offsets of the sorted slots with one pass over the report
+static void locate_scanned(FILE *file, BatchSlot *slots, size_t count) {
+    char line[1024];
     rewind(file);
-    
-    // Send file transfer marker and transfer the file directly
-    send_line_fd(client_fd, "FILE_TRANSFER_START:CB.txt");
-    
-    // Send file size
-    char size_msg[64];
-    snprintf(size_msg, sizeof(size_msg), "FILE_SIZE:%ld", filesize);
-    send_line_fd(client_fd, size_msg);
-    
-    // Send file data in chunks
-    char buffer[8192];
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        if (sendall_fd(client_fd, buffer, bytes_read) != 0) {
-            fclose(file);
-            return;
+    off_t pos = 0;
+    while (fgets(line, sizeof(line), file)) {
+        long current_msisdn;
+        if (strncmp(line, "Customer ID: ", 13) == 0 &&
+            sscanf(line, "Customer ID: %ld", &current_msisdn) == 1) {
+            BatchSlot key = { current_msisdn, 0 };
+            BatchSlot *hit = (BatchSlot *)bsearch(&key, slots, count, sizeof(BatchSlot), compare_slot);
+            if (hit) {
+                // Duplicates in the request share one slot value
+                while (hit > slots && hit[-1].msisdn == current_msisdn) hit--;
+                for (; hit < slots + count && hit->msisdn == current_msisdn; hit++)
+                    if (hit->offset < 0) hit->offset = pos;
+            }
         }
+        pos = ftello(file);
     }
-    
+}
+
+// Send the block at offset if it is msisdn's; returns 1 if sent
+static int send_block_at(Conn *conn, FILE *file, off_t offset, long msisdn) {
+    char line[1024];
+    long current_msisdn;
+    if (offset < 0 || fseeko(file, offset, SEEK_SET) != 0 ||
+        !fgets(line, sizeof(line), file) ||
+        sscanf(line, "Customer ID: %ld", &current_msisdn) != 1 ||
+        current_msisdn != msisdn)
+        return 0;
+    send_customer_block(conn, file, line, sizeof(line));
+    return 1;
+}
+
+static void send_batch_summary(Conn *conn, size_t found, size_t count) {
+    send_linef(conn, "Batch search complete: %zu found, %zu not found.", found, count - found);
+}
+
+int search_msisdn_batch(Conn *conn, const char *filename, const long *msisdns, size_t count) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        send_error(conn, "Error opening file: %s", strerror(errno));
+        send_line(conn, "Note: Please process the CDR data first (option 1 from secondary menu).");
+        return -1;
+    }
+
+    // Resolve every offset at once, then answer in request order
+    BatchSlot *slots = (BatchSlot *)malloc((count ? count : 1) * sizeof(BatchSlot));
+    off_t *offsets = (off_t *)malloc((count ? count : 1) * sizeof(off_t));
+    if (!slots || !offsets) {
+        free(slots);
+        free(offsets);
+        fclose(file);
+        send_error(conn, "Error: not enough memory for the batch.");
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        slots[i].msisdn = msisdns[i];
+        slots[i].offset = -1;
+    }
+    qsort(slots, count, sizeof(BatchSlot), compare_slot);
+    if (locate_indexed(file, filename, slots, count) != 0)
+        locate_scanned(file, slots, count);
+
+    for (size_t i = 0; i < count; i++) {
+        BatchSlot key = { msisdns[i], 0 };
+        BatchSlot *hit = (BatchSlot *)bsearch(&key, slots, count, sizeof(BatchSlot), compare_slot);
+        offsets[i] = hit ? hit->offset : -1;
+    }
+    free(slots);
+
+    send_linef(conn, "Batch search: %zu MSISDNs", count);
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (send_block_at(conn, file, offsets[i], msisdns[i])) found++;
+        else send_linef(conn, "Customer with MSISDN %ld not found.", msisdns[i]);
+    }
+    send_batch_summary(conn, found, count);
+
+    free(offsets);
     fclose(file);
-    send_line_fd(client_fd, "FILE_TRANSFER_COMPLETE");
-}
\ No newline at end of file
+    return 0;
+}
+
+void search_msisdn_batch_table(Conn *conn, const CustomerTable *table,
+                               const OpTable *operators, const long *msisdns, size_t count) {
+    send_linef(conn, "Batch search: %zu MSISDNs", count);
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++)
+        found += (size_t)search_msisdn_table(conn, table, operators, msisdns[i]);
+    send_batch_summary(conn, found, count);
+}
+
+void display_customer_billing_file(Conn *conn, const char *filename) {
+    if (send_report_file(conn, filename, "CB.txt") == -1) {
+        send_error(conn, "Error opening file: %s", strerror(errno));
+        send_line(conn, "Note: Please process the CDR data first using option 1 from the main menu.");
+    }
+}
@@ -7,176 +7,244 @@
 #include <errno.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
 #include "../Header/IntopBillProcess.h"
+#include "../Header/transfer.h"
 
 #define MAX_LINE 1024
 
-// Helper function to send a line to client via socket
-static int send_line_fd(int fd, const char *line) {
-    size_t len = strlen(line);
-    ssize_t sent = send(fd, line, len, 0);
-    return (sent == (ssize_t)len) ? 0 : -1;
+/* ==== Report blocks ==== */
+
+// Operator blocks of an IOSB.txt report, in report order
+typedef struct {
+    int count;
+    int capacity;
+    char **names;       // operator names as printed on the brand line
+    int *codes;
+    uint64_t *offsets;  // block start in the report
+    uint32_t *lengths;  // block length including the separator line
+} ReportBlocks;
+
+static void free_report_blocks(ReportBlocks *blocks) {
+    for (int i = 0; i < blocks->count; i++) free(blocks->names[i]);
+    free(blocks->names);
+    free(blocks->codes);
+    free(blocks->offsets);
+    free(blocks->lengths);
+    memset(blocks, 0, sizeof(*blocks));
 }
 
-// Helper function to convert a string to lowercase
-static void to_lowercase(char *str) {
-    for (int i = 0; str[i]; i++) {
-        str[i] = tolower((unsigned char)str[i]);
+static int add_report_block(ReportBlocks *blocks, const char *name, size_t name_len,
+                            int code, uint64_t offset, uint32_t length) {
+    if (blocks->count == blocks->capacity) {
+        int cap = blocks->capacity ? blocks->capacity * 2 : 64;
+        char **names = (char **)realloc(blocks->names, (size_t)cap * sizeof(char *));
+        if (names) blocks->names = names;
+        int *codes = (int *)realloc(blocks->codes, (size_t)cap * sizeof(int));
+        if (codes) blocks->codes = codes;
+        uint64_t *offsets = (uint64_t *)realloc(blocks->offsets, (size_t)cap * sizeof(uint64_t));
+        if (offsets) blocks->offsets = offsets;
+        uint32_t *lengths = (uint32_t *)realloc(blocks->lengths, (size_t)cap * sizeof(uint32_t));
+        if (lengths) blocks->lengths = lengths;
+        if (!names || !codes || !offsets || !lengths) return -1;
+        blocks->capacity = cap;
     }
-}
 
-void search_operator(int client_fd, const char *filename, const char *operator_input) {
-    FILE *file = fopen(filename, "r");
-    char line[MAX_LINE];
-    int found = 0;
+    char *copy = (char *)malloc(name_len + 1);
+    if (!copy) return -1;
+    memcpy(copy, name, name_len);
+    copy[name_len] = '\0';
 
-    if (!file) {
-        char msg[512];
-        snprintf(msg, sizeof(msg), "Error opening file: %s\n", strerror(errno));
-        send_line_fd(client_fd, msg);
-        snprintf(msg, sizeof(msg), "Filename: %s\n", filename);
-        send_line_fd(client_fd, msg);
-        send_line_fd(client_fd, "Note: Please process the CDR data first using option 1 from the main menu.\n");
-        return;
-    }
+    int i = blocks->count++;
+    blocks->names[i] = copy;
+    blocks->codes[i] = code;
+    blocks->offsets[i] = offset;
+    blocks->lengths[i] = length;
+    return 0;
+}
 
-    // Convert user input to lowercase
-    char operator_lower[100];
-    strncpy(operator_lower, operator_input, sizeof(operator_lower) - 1);
-    operator_lower[sizeof(operator_lower) - 1] = '\0';
-    to_lowercase(operator_lower);
+static int compare_entry_offset(const void *a, const void *b) {
+    const IosbIndexEntry *x = (const IosbIndexEntry *)a;
+    const IosbIndexEntry *y = (const IosbIndexEntry *)b;
+    return (x->block_offset > y->block_offset) - (x->block_offset < y->block_offset);
+}
 
-    while (fgets(line, sizeof(line), file)) {
-        // Make a lowercase copy of the line
-        char line_lower[MAX_LINE];
-        strncpy(line_lower, line, sizeof(line_lower) - 1);
-        line_lower[sizeof(line_lower) - 1] = '\0';
-        to_lowercase(line_lower);
-
-        // Check if this line contains "Operator Brand:" and the searched operator
-        if (strstr(line_lower, "operator brand:") && strstr(line_lower, operator_lower)) {
-            found = 1;
-            // Send this line (Operator Brand line)
-            if (send_line_fd(client_fd, line) < 0) {
-                fclose(file);
-                return;
-            }
-            
-            // Send the next 6 lines (operator details)
-            for (int i = 0; i < 6; i++) {
-                if (fgets(line, sizeof(line), file)) {
-                    if (send_line_fd(client_fd, line) < 0) {
-                        fclose(file);
-                        return;
-                    }
-                }
-            }
-            break;
+// Load the blocks from <filename>.idx if it was written for the report as it
+// is now (same inode, size and mtime). Returns 0 on success.
+static int load_report_index(const char *filename, const struct stat *report, ReportBlocks *blocks) {
+    char path[600];
+    if (snprintf(path, sizeof(path), "%s%s", filename, IOSB_INDEX_SUFFIX) >= (int)sizeof(path))
+        return -1;
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+
+    IosbIndexHeader hdr;
+    IosbIndexEntry *entries = NULL;
+    char *names = NULL;
+    int rc = -1;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, IOSB_INDEX_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != IOSB_INDEX_VERSION ||
+        hdr.reportSize != (uint64_t)report->st_size ||
+        hdr.reportIno != (uint64_t)report->st_ino ||
+        hdr.reportMtimeSec != (int64_t)report->st_mtim.tv_sec ||
+        hdr.reportMtimeNsec != (int64_t)report->st_mtim.tv_nsec ||
+        hdr.count > (uint64_t)report->st_size || hdr.namesSize > (uint64_t)report->st_size)
+        goto done;
+
+    entries = (IosbIndexEntry *)malloc(((size_t)hdr.count + 1) * sizeof(IosbIndexEntry));
+    names = (char *)malloc((size_t)hdr.namesSize + 1);
+    if (!entries || !names ||
+        fread(entries, sizeof(IosbIndexEntry), hdr.count, fp) != hdr.count ||
+        fread(names, 1, (size_t)hdr.namesSize, fp) != (size_t)hdr.namesSize)
+        goto done;
+
+    // Serve matches in report order, as the scan would
+    qsort(entries, hdr.count, sizeof(IosbIndexEntry), compare_entry_offset);
+    for (uint32_t i = 0; i < hdr.count; i++) {
+        const IosbIndexEntry *e = &entries[i];
+        if ((uint64_t)e->name_offset + e->name_len > hdr.namesSize ||
+            e->block_offset + e->block_len > hdr.reportSize ||
+            add_report_block(blocks, names + e->name_offset, e->name_len,
+                             e->operator_code, e->block_offset, e->block_len) != 0) {
+            free_report_blocks(blocks);
+            goto done;
         }
     }
+    rc = 0;
 
-    if (!found) {
-        char msg[256];
-        snprintf(msg, sizeof(msg), "Operator '%s' not found.\n", operator_input);
-        send_line_fd(client_fd, msg);
-    }
-
-    fclose(file);
+done:
+    free(entries);
+    free(names);
+    fclose(fp);
+    return rc;
 }
 
-// Helper for sending all bytes
-static int sendall_fd(int sock, const char *buf, size_t len) {
-    size_t total = 0;
-    int retry_count = 0;
-    const int MAX_RETRIES = 3;
-    
-    while (total < len) {
-        ssize_t n = send(sock, buf + total, len - total, 0);
-        
-        if (n > 0) {
-            total += n;
-            retry_count = 0;
-        } else if (n == 0) {
-            return -1;
-        } else {
-            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
-                retry_count++;
-                if (retry_count > MAX_RETRIES) {
-                    return -1;
-                }
-                usleep(1000);
-                continue;
+// Collect the blocks by reading the report. Each block runs from its
+// "Operator Brand: NAME (CODE)" line through the separator line.
+static int scan_report_blocks(FILE *file, ReportBlocks *blocks) {
+    char line[MAX_LINE];
+    uint64_t pos = 0;
+    int open = 0;
+    const char *prefix = "Operator Brand: ";
+    size_t prefix_len = strlen(prefix);
+
+    while (fgets(line, sizeof(line), file)) {
+        size_t len = strlen(line);
+        if (strncmp(line, prefix, prefix_len) == 0) {
+            // Name is everything up to a trailing " (CODE)"
+            const char *name = line + prefix_len;
+            size_t name_len = strcspn(name, "\r\n");
+            int code = -1;
+            const char *paren = NULL;
+            for (const char *p = name; p < name + name_len; p++)
+                if (*p == '(') paren = p;
+            if (paren && paren > name && paren[-1] == ' ' && isdigit((unsigned char)paren[1])) {
+                code = atoi(paren + 1);
+                name_len = (size_t)(paren - 1 - name);
             }
-            return -1;
+            if (add_report_block(blocks, name, name_len, code, pos, 0) != 0) return -1;
+            open = 1;
+        }
+        pos += len;
+        if (open && blocks->count > 0) {
+            int i = blocks->count - 1;
+            blocks->lengths[i] = (uint32_t)(pos - blocks->offsets[i]);
+            if (strncmp(line, "----", 4) == 0) open = 0;
         }
     }
     return 0;
 }
 
-void display_interoperator_billing_file(int client_fd, const char *filename) {
+static int build_report_index(const ReportBlocks *blocks, OpNameIndex *index) {
+    return op_name_index_build(index, (const char *const *)blocks->names, blocks->codes, blocks->count);
+}
+
+static void send_not_found(Conn *conn, const char *operator_input) {
+    send_linef(conn, "Operator '%s' not found.", operator_input);
+}
+
+// Matches the operator name case-insensitively: an exact name (or operator
+// code) first, otherwise every name starting with the term, otherwise every
+// name containing it. All matching blocks are sent in report order.
+void search_operator(Conn *conn, const char *filename, const char *operator_input) {
     FILE *file = fopen(filename, "r");
-    char line[MAX_LINE];
-    int line_count = 0;
 
     if (!file) {
-        char msg[512];
-        snprintf(msg, sizeof(msg), "Error opening file: %s\n", strerror(errno));
-        send_line_fd(client_fd, msg);
-        snprintf(msg, sizeof(msg), "Filename: %s\n", filename);
-        send_line_fd(client_fd, msg);
-        send_line_fd(client_fd, "Note: Please process the CDR data first using option 1 from the main menu.\n");
+        send_error(conn, "Error opening file: %s", strerror(errno));
+        send_linef(conn, "Filename: %s", filename);
+        send_line(conn, "Note: Please process the CDR data first using option 1 from the main menu.");
         return;
     }
 
-    send_line_fd(client_fd, "=== Interoperator Billing File Content ===\n");
-
-    while (fgets(line, sizeof(line), file)) {
-        if (send_line_fd(client_fd, line) < 0) {
-            // Client disconnected
+    ReportBlocks blocks;
+    memset(&blocks, 0, sizeof(blocks));
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || load_report_index(filename, &st, &blocks) != 0) {
+        if (scan_report_blocks(file, &blocks) != 0) {
+            send_error(conn, "Error: out of memory while searching.");
+            free_report_blocks(&blocks);
             fclose(file);
             return;
         }
-        
-        line_count++;
-        // Add a small delay every 10 lines to prevent socket buffer overflow
-        if (line_count % 10 == 0) {
-            usleep(10000); // 10ms delay
-        }
     }
 
-    send_line_fd(client_fd, "=== End of File ===\n");
-    fclose(file);
-    
-    // Now send the file transfer marker and transfer the file
-    send_line_fd(client_fd, "FILE_TRANSFER_START:IOSB.txt\n");
-    
-    // Reopen file for binary transfer
-    file = fopen(filename, "rb");
-    if (!file) {
-        send_line_fd(client_fd, "FILE_TRANSFER_ERROR\n");
-        return;
+    OpNameIndex index;
+    int *matches = (int *)malloc((size_t)(blocks.count + 1) * sizeof(int));
+    int n = 0;
+    if (matches && build_report_index(&blocks, &index) == 0) {
+        n = op_name_index_lookup(&index, operator_input, matches, blocks.count);
+        op_name_index_free(&index);
     }
-    
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long filesize = ftell(file);
-    rewind(file);
-    
-    // Send file size
-    char size_msg[64];
-    snprintf(size_msg, sizeof(size_msg), "FILE_SIZE:%ld\n", filesize);
-    send_line_fd(client_fd, size_msg);
-    
-    // Send file data in chunks
-    char buffer[8192];
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        if (sendall_fd(client_fd, buffer, bytes_read) != 0) {
-            fclose(file);
+
+    for (int i = 0; i < n; i++) {
+        int b = matches[i];
+        if (send_file_range(conn, fileno(file), (off_t)blocks.offsets[b], blocks.lengths[b]) != 0)
+            break;
+    }
+
+    if (n == 0) send_not_found(conn, operator_input);
+
+    free(matches);
+    free_report_blocks(&blocks);
+    fclose(file);
+}
+
+// Search the resident aggregates of the latest run; matching and reply are
+// the same as the IOSB.txt search above. Without a prebuilt index one is
+// built for this lookup.
+void search_operator_table(Conn *conn, const OpTable *table, const OpNameIndex *index,
+                           const char *operator_input) {
+    OpNameIndex local;
+    memset(&local, 0, sizeof(local));
+    if (!index || index->count != table->count) {
+        if (op_name_index_build_table(&local, table) != 0) {
+            send_error(conn, "Error: out of memory while searching.");
             return;
         }
+        index = &local;
+    }
+
+    int *matches = (int *)malloc((size_t)(table->count + 1) * sizeof(int));
+    int n = matches ? op_name_index_lookup(index, operator_input, matches, table->count) : 0;
+
+    char block[OP_RECORD_MAX];
+    for (int i = 0; i < n; i++) {
+        format_operator_record(block, sizeof(block), &table->nodes[matches[i]]);
+        if (conn_write(conn, block, strlen(block)) < 0) break;
+    }
+
+    if (n == 0) send_not_found(conn, operator_input);
+
+    free(matches);
+    op_name_index_free(&local);
+}
+
+void display_interoperator_billing_file(Conn *conn, const char *filename) {
+    if (send_report_file(conn, filename, "IOSB.txt") == -1) {
+        send_error(conn, "Error opening file: %s", strerror(errno));
+        send_linef(conn, "Filename: %s", filename);
+        send_line(conn, "Note: Please process the CDR data first using option 1 from the main menu.");
     }
-    
-    fclose(file);
-    send_line_fd(client_fd, "FILE_TRANSFER_COMPLETE\n");
 }
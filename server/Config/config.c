@@ -0,0 +1,22 @@
+// config.c - Runtime tunables read from the environment
+#include "../Header/config.h"
+
+long config_long(const char *name, long def)
+{
+    const char *s = getenv(name);
+    if (!s || *s == '\0') return def;
+
+    char *endptr;
+    long v = strtol(s, &endptr, 10);
+    if (endptr == s || *endptr != '\0') {
+        fprintf(stderr, "Ignoring invalid %s='%s'\n", name, s);
+        return def;
+    }
+    return v;
+}
+
+int config_online_cpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
@@ -0,0 +1,41 @@
+#ifndef BILLINGJOB_H
+#define BILLINGJOB_H
+
+#include "CustBillProcess.h"
+#include "IntopBillProcess.h"
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+// Everything one "Process the CDR data" run owns. Nothing is shared between
+// jobs, so any number of users can bill concurrently.
+typedef struct BillingJob {
+    char input_path[256];
+    char output_dir[256];
+    long records;               // CDR lines ingested
+    size_t input_bytes;         // input this run reads, 0 if unknown
+    int unterminated;           // billed a last line without newline, not in the snapshot
+    uint64_t hash_offset;       // result cache hash state of input [0, hash_offset),
+    uint64_t hash_state;        // saved with the snapshot
+    CdrProgress progress;       // advanced while the input is read
+    CustomerTable customers;    // merged customer aggregates
+    OpTable operators;          // merged operator aggregates
+} BillingJob;
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Allocate an empty job reading input_path and reporting into output_dir
+BillingJob* billing_job_create(const char *input_path, const char *output_dir);
+
+// Ingest the CDR file on nthreads workers into the job's tables, resuming
+// from the output directory's snapshot when incremental mode is on.
+// Returns the number of records read in this run, or -1 on error.
+long billing_job_ingest(BillingJob *job, int nthreads);
+
+// Release the job and all aggregates it still owns
+void billing_job_destroy(BillingJob *job);
+
+#endif // BILLINGJOB_H
@@ -0,0 +1,120 @@
+#ifndef CDRCACHE_H
+#define CDRCACHE_H
+
+#include <stdint.h>
+#include "CdrIngest.h"
+
+/* ============================================================
+   Constants
+   ============================================================ */
+#define CDR_CACHE_SUFFIX ".bin"          // cache lives next to the text file
+#define CDR_CACHE_MAGIC "CDRCOL\r\n"     // 8 bytes, catches text-mode mangling
+#define CDR_CACHE_VERSION 2
+#define CDR_CACHE_ALIGN 64               // column start alignment in the file
+#define CDR_CACHE_MAX_NAMES 65535        // dictionary index is a uint16_t
+
+// Typed columns, one value per record, in file order
+typedef enum {
+    CDR_COL_MSISDN = 0,     // int64_t
+    CDR_COL_OP_CODE,        // int32_t
+    CDR_COL_OP_NAME,        // uint16_t index into the name dictionary
+    CDR_COL_CALL_TYPE,      // uint8_t CallType
+    CDR_COL_DURATION,       // float
+    CDR_COL_DOWNLOAD,       // float
+    CDR_COL_UPLOAD,         // float
+    CDR_COL_TP_MSISDN,      // int64_t, 0 when empty
+    CDR_COL_TP_OP_CODE,     // int32_t
+    CDR_COL_FLAGS,          // uint8_t CDR_FLAG_*
+    CDR_COL_DURATION_UNITS, // int64_t, CdrRecord.durationUnits
+    CDR_COL_DOWNLOAD_UNITS, // int64_t
+    CDR_COL_UPLOAD_UNITS,   // int64_t
+    CDR_NUM_COLUMNS
+} CdrColumn;
+
+#define CDR_FLAG_COMPLETE 0x01
+#define CDR_FLAG_EXACT_CALL_TYPE 0x02   // CdrRecord.callTypeExact
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+// On-disk header at offset 0. The cache is only trusted while the size and
+// mtime of the text file still match what was recorded at conversion time.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t sourceSize;
+    int64_t sourceMtimeSec;
+    int64_t sourceMtimeNsec;
+    uint64_t records;
+    uint64_t columnOffset[CDR_NUM_COLUMNS];
+    uint64_t namesOffset;       // CdrCacheName[nameCount]
+    uint64_t blobOffset;        // name and operator id text, not NUL-terminated
+    uint64_t blobSize;
+    uint32_t nameCount;
+    uint32_t reserved;
+} CdrCacheHeader;
+
+// Dictionary entry: operator name followed by the raw operator id text
+typedef struct {
+    uint32_t offset;            // into the blob
+    uint16_t nameLen;
+    uint16_t idLen;
+} CdrCacheName;
+
+// Columns and dictionary of one slice being converted (see CdrCache.c)
+typedef struct CdrCacheWriter CdrCacheWriter;
+
+// A validated, mapped cache file
+typedef struct {
+    const unsigned char *map;
+    size_t size;
+    size_t sourceSize;          // bytes of CDR text the cache was built from
+    size_t records;
+    const int64_t *msisdn;
+    const int32_t *opCode;
+    const uint16_t *opName;
+    const uint8_t *callType;
+    const float *duration;
+    const float *download;
+    const float *upload;
+    const int64_t *tpMsisdn;
+    const int32_t *tpOpCode;
+    const uint8_t *flags;
+    const int64_t *durationUnits;
+    const int64_t *downloadUnits;
+    const int64_t *uploadUnits;
+    const CdrCacheName *names;
+    uint32_t nameCount;
+    const char *blob;
+} CdrCache;
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Cache path for a CDR text file. Returns 0, or -1 if it does not fit.
+int cdr_cache_path(const char *filename, char *out, size_t outlen);
+
+// Map the cache of filename if it exists, is well-formed and up to date.
+// Returns 0 on success, -1 if the text file has to be parsed instead.
+int cdr_cache_open(const char *filename, CdrCache *cache);
+void cdr_cache_close(CdrCache *cache);
+
+// Column writer for one slice of the text file, presized for expected
+// records. Returns NULL when out of memory.
+CdrCacheWriter *cdr_cache_writer_new(size_t expected);
+void cdr_cache_writer_add(CdrCacheWriter *w, const CdrRecord *rec);
+void cdr_cache_writer_free(CdrCacheWriter *w);
+
+// Write the cache of filename from the writers of its slices, in file order
+// (to a temporary file renamed into place). src is the stat of the text the
+// slices were read from. Returns 0, or -1 if any slice failed or on error.
+int cdr_cache_write(const char *filename, const struct stat *src,
+                    CdrCacheWriter **slices, int nslices);
+
+// Deliver records [begin, end) of an open cache to sink as CdrRecords
+long cdr_cache_ingest(const CdrCache *cache, size_t begin, size_t end, CdrSink sink, void *ctx);
+
+#endif // CDRCACHE_H
@@ -0,0 +1,115 @@
+#ifndef CDRINGEST_H
+#define CDRINGEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* ============================================================
+   Constants
+   ============================================================ */
+#define CDR_INPUT_FILE "data/data.cdr"
+#define CDR_NUM_FIELDS 9
+#define CDR_MIN_SLICE (4L << 20)   // smallest byte range worth its own ingest thread
+#define CDR_AVG_RECORD_BYTES 48    // typical line length, used to presize tables
+#define CDR_PROGRESS_BYTES (1L << 20)  // input consumed between progress updates
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+// Call types carried in field 4 of a CDR line
+typedef enum {
+    CALL_UNKNOWN = 0,
+    CALL_MOC,       // Mobile Originated Call
+    CALL_MTC,       // Mobile Terminated Call
+    CALL_SMS_MO,    // SMS Mobile Originated
+    CALL_SMS_MT,    // SMS Mobile Terminated
+    CALL_GPRS       // Data session
+} CallType;
+
+// One decoded CDR line, shared by the customer and interoperator aggregators.
+// String fields point into the input buffer, are NOT NUL-terminated and are
+// only valid inside the sink.
+typedef struct CdrRecord {
+    long msisdn;
+    const char *operatorName;
+    int operatorNameLen;
+    const char *operatorId;     // raw operator code text
+    int operatorIdLen;          // 0 if missing
+    int operatorCode;
+    CallType callType;          // matched regardless of case, as interop billing does
+    int callTypeExact;          // 1 if written in upper case, as customer billing requires
+    float duration;
+    float download;
+    float upload;
+    long durationUnits;         // leading integer of duration, download and upload,
+    long downloadUnits;         // read as strtol() does, for the interoperator sums
+    long uploadUnits;
+    long thirdPartyMsisdn;      // 0 when empty (GPRS records)
+    int thirdPartyOpCode;
+    int complete;               // 1 if every field customer billing needs was parsed
+} CdrRecord;
+
+// Progress of a running ingest, shared by all its slices. Each slice adds
+// its counts every CDR_PROGRESS_BYTES of input; read with __atomic_load_n.
+typedef struct {
+    long records;               // records delivered so far
+    size_t bytes;               // input bytes consumed so far
+} CdrProgress;
+
+// Callback invoked once per decoded record
+typedef void (*CdrSink)(const CdrRecord *rec, void *ctx);
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Decode one pipe-separated record in [line, end) without modifying it.
+// Empty fields (||) are handled natively. Returns 0 for blank lines.
+int cdr_decode(const char *line, const char *end, CdrRecord *rec);
+int cdr_decode_line(char *line, CdrRecord *rec);
+
+// Map call type text (case-insensitive) to its enum value
+CallType cdr_call_type_n(const char *s, size_t len);
+CallType cdr_call_type(const char *s);
+
+// Rough record count of a CDR file from its size (0 if it cannot be read)
+size_t cdr_estimate_records(const char *filename);
+
+// Decode every newline-terminated record in a buffer
+long cdr_ingest_buffer(const char *data, size_t size, CdrSink sink, void *ctx);
+
+// Memory-map the CDR file and hand every decoded record to sink.
+// Returns the number of records delivered, or -1 if the file cannot be opened.
+long cdr_ingest_file(const char *filename, CdrSink sink, void *ctx);
+
+// Split the mapped CDR file into newline-aligned byte ranges and decode them
+// on up to nthreads threads; range i is delivered to sink with ctxs[i].
+// Ranges follow file order, so merging ctxs in index order keeps first-seen
+// semantics. Returns the total number of records, or -1 on error.
+long cdr_ingest_file_parallel(const char *filename, int nthreads, CdrSink sink, void **ctxs);
+
+// Same as cdr_ingest_file_parallel for the bytes [begin, end) only; begin
+// must be the start of a record and end is clamped to the file size.
+// progress, if not NULL, is advanced while the range is read.
+long cdr_ingest_file_range(const char *filename, size_t begin, size_t end,
+                           int nthreads, CdrSink sink, void **ctxs,
+                           CdrProgress *progress);
+
+// Size of a regular CDR file and the offset just past its last complete
+// (newline-terminated) record. Returns 0, or -1 if it cannot be read.
+int cdr_file_extent(const char *filename, size_t *size, size_t *complete);
+
+#endif // CDRINGEST_H
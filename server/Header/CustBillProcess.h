@@ -6,21 +6,34 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "CdrIngest.h"
+#include "conn.h"
+#include "IntopBillProcess.h"
+#include "arena.h"
 
 /* ============================================================
    Constants
    ============================================================ */
-#define HASH_SIZE 1000
+#define CUST_MIN_CAPACITY 1024        // initial slot count (power of two)
+#define CUST_MAX_LOAD_PCT 70          // grow when occupancy would exceed this
+#define CUST_CHUNK_SHIFT 14           // customers per storage chunk: 16384 (1 MiB)
+#define CUST_RECORDS_PER_CUSTOMER 8   // presize estimate: CDR lines per subscriber
+#define CUST_RECORD_MAX 1024          // formatted CB.txt block, name included
+#define CB_INDEX_SUFFIX ".idx"        // MSISDN index written next to CB.txt
+#define CB_INDEX_MAGIC "CBIDX\r\n"    // 8 bytes with the terminator
+#define CB_INDEX_VERSION 1
 
 /* ============================================================
    Data Structures
    ============================================================ */
 
-// Customer structure for billing
+// Customer structure for billing. Every counter touched during aggregation
+// sits in one 64-byte cache line; the operator is a small index into the
+// job's OpTable instead of a copy of its name.
 typedef struct Customer {
     long msisdn;
-    char operatorName[64];
-    int operatorCode;
     
     // Voice call durations (within and outside operator)
     float inVoiceWithin;
@@ -28,45 +41,100 @@ typedef struct Customer {
     float inVoiceOutside;
     float outVoiceOutside;
     
+    // Data usage
+    float mbDownload;
+    float mbUpload;
+    
     // SMS counts
     int smsInWithin;
     int smsOutWithin;
     int smsInOutside;
     int smsOutOutside;
     
-    // Data usage
-    float mbDownload;
-    float mbUpload;
-    
-    struct Customer *next; // for hash collision chaining
-} Customer;
+    uint16_t opIndex;   // interned operator, see operator_name_at()
+} __attribute__((aligned(64))) Customer;
+
+// Open addressing slot: upper hash bits as a tag, so most mismatching probes
+// are rejected without touching the customer record
+typedef struct {
+    uint32_t tag;
+    uint32_t index;     // customer index + 1, 0 marks an empty slot
+} CustomerSlot;
+
+// Growable linear-probing customer table. A zeroed table is valid and empty.
+// Customers are stored densely, in first-seen order, in fixed-size chunks so
+// they never move. Workers aggregate into private tables that are merged
+// once ingest completes.
+typedef struct CustomerTable {
+    CustomerSlot *slots;
+    size_t capacity;    // power of two
+    size_t count;       // customers stored
+    Customer **chunks;  // chunk i holds customers [i << CUST_CHUNK_SHIFT, ...)
+    size_t nchunks;     // length of the chunks array
+    int totalRecords;
+    Arena arena;        // owns the chunks
+} CustomerTable;
 
-// Thread argument structure for passing output directory
+// CB.txt index header; sorted CBIndexEntry records follow. The report's
+// size, mtime and inode tie the index to the exact file it was built for.
 typedef struct {
-    char output_dir[256];
-} ProcessThreadArg;
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t reportSize;
+    int64_t reportMtimeSec;
+    int64_t reportMtimeNsec;
+    uint64_t reportIno;
+    uint64_t count;
+} CBIndexHeader;
+
+typedef struct {
+    int64_t msisdn;
+    uint64_t offset;    // start of the "Customer ID" line
+} CBIndexEntry;
 
 /* ============================================================
    Function Declarations
    ============================================================ */
 
-// Thread entry point
-void* custbillprocess(void *arg);
+// Report entry point (arg: BillingJob*, writes CB.txt after ingest).
+// Returns 0, or -1 if the report could not be written.
+int custbillreport(void *arg);
 
 // Search and display functions
-void search_msisdn(int client_fd, const char *filename, long msisdn);
-void display_customer_billing_file(int client_fd, const char *filename);
+void search_msisdn(Conn *conn, const char *filename, long msisdn);
+int search_msisdn_table(Conn *conn, const CustomerTable *table,
+                        const OpTable *operators, long msisdn);
+// Answer several MSISDNs in request order with one pass over the report, or
+// its index, followed by a found/not found summary
+int search_msisdn_batch(Conn *conn, const char *filename, const long *msisdns, size_t count);
+void search_msisdn_batch_table(Conn *conn, const CustomerTable *table,
+                               const OpTable *operators, const long *msisdns, size_t count);
+void display_customer_billing_file(Conn *conn, const char *filename);
 
 // Customer processing functions
-Customer* createCustomer(long msisdn, const char *operatorName, int operatorCode);
-Customer* getCustomer(long msisdn, const char *operatorName, int operatorCode);
+Customer* createCustomer(CustomerTable *table, long msisdn, int opIndex);
+Customer* getCustomer(CustomerTable *table, long msisdn, int opIndex);
+Customer* customerAt(const CustomerTable *table, size_t index);
+Customer* findCustomer(const CustomerTable *table, long msisdn);
+
+// Presize for about expected customers. Returns 0 on success.
+int reserveCustomerTable(CustomerTable *table, size_t expected);
 
 // CDR processing functions
-void processCDRFile(const char *filename);
-void writeCBFile(const char *outputFile);
-void cleanupHashTable(void);
+void addCustomerRecord(CustomerTable *table, const CdrRecord *rec, int opIndex);
+void mergeCustomerTable(CustomerTable *dst, CustomerTable *partial, const int *opRemap);
+// Merge count partial tables into dst as if one after another, on nthreads
+// threads that each own a hash range of the customers. opRemaps[i] is
+// partial i's operator remap. The partial tables are left empty.
+void mergeCustomerTables(CustomerTable *dst, CustomerTable **partials, int *const *opRemaps,
+                         int count, int nthreads);
+void processCDRFile(CustomerTable *table, OpTable *operators, const char *filename);
+int writeCBFile(const CustomerTable *table, const OpTable *operators, const char *outputFile);
+int formatCustomerRecord(char *buf, size_t len, const Customer *cust, const char *operatorName);
+void freeCustomerTable(CustomerTable *table);
 
 // Hash function
-unsigned int hashFunction(long key);
+uint64_t hashFunction(long key);
 
 #endif // CUSTBILLPROCESS_H
@@ -6,11 +6,21 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <stdint.h>
+#include "CdrIngest.h"
+#include "conn.h"
+#include "arena.h"
 
 /* ============================================================
    Constants
    ============================================================ */
-#define NUM_BUCKETS 4096
+#define OP_MIN_CAPACITY 16      // initial operator slots
+#define OP_MAX_OPERATORS 65535  // operator index must fit a customer's uint16_t
+#define OP_RECORD_MAX 1024      // formatted IOSB.txt block, name included
+#define OP_QUERY_MAX 256        // longest operator search term
+#define IOSB_INDEX_SUFFIX ".idx"        // operator name index written next to IOSB.txt
+#define IOSB_INDEX_MAGIC "IOSBIDX\n"    // 8 bytes
+#define IOSB_INDEX_VERSION 1
 
 /* ============================================================
    Data Structures
@@ -29,35 +39,110 @@ typedef struct OperatorStats
 
 typedef struct OpNode
 {
-    char *operator_id;   // hash map (key) operator_id
-    OperatorStats stats; // Hash map (Value)
-    struct OpNode *next; // Chaining (linked list)
+    char *operator_id;   // key: operator id text as written in the CDRs
+    int operator_code;   // its numeric value, for searches by code
+    OperatorStats stats; // value
 } OpNode;
 
+// Operator table and name intern table in one: every operator id seen is
+// given a small dense index (first-seen order) that customer records store
+// instead of a copy of the name. Workers aggregate into private tables that
+// are merged once ingest completes. A zeroed table is valid and empty.
+typedef struct OpTable
+{
+    OpNode *nodes;       // indexed by operator index
+    int count;
+    int capacity;
+    int *slots;          // open addressing on operator id: node index + 1, 0 = empty
+    int slot_mask;       // slot count - 1; slot count is twice capacity
+    int full;            // an operator was refused at OP_MAX_OPERATORS
+    Arena arena;         // owns operator ids and names
+} OpTable;
+
+// Case-folded operator name index. Entries are sorted by folded name so
+// exact and prefix lookups are a binary search; substring lookups walk
+// the folded names only.
+typedef struct OpNameEntry
+{
+    const char *folded;  // lowercased operator name
+    int operator_code;
+    int index;           // record the entry stands for (OpTable node or IOSB block)
+} OpNameEntry;
+
+typedef struct OpNameIndex
+{
+    OpNameEntry *entries;
+    int count;
+    char *names;         // owns the folded names
+} OpNameIndex;
+
+// IOSB.txt index header. Entries (sorted as in OpNameIndex) and the folded
+// name text follow; the report's size, mtime and inode tie it to one file.
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t reportSize;
+    int64_t reportMtimeSec;
+    int64_t reportMtimeNsec;
+    uint64_t reportIno;
+    uint64_t namesSize;
+} IosbIndexHeader;
+
+typedef struct
+{
+    uint32_t name_offset;   // into the folded name text
+    uint32_t name_len;
+    int32_t operator_code;
+    uint32_t block_len;     // bytes of the report block
+    uint64_t block_offset;  // start of the "Operator Brand" line
+} IosbIndexEntry;
+
 /* ============================================================
    Function Declarations
    ============================================================ */
 
-// Thread entry point
-void* intopbillprocess(void *arg);
+// Report entry point (arg: BillingJob*, writes IOSB.txt after ingest).
+// Returns 0, or -1 if the report could not be written.
+int intopbillreport(void *arg);
 
-// Main processing function
+// Main processing functions
 void InteroperatorBillingProcess(const char *input_path, const char *output_path);
+int InteroperatorBillingReport(const OpTable *table, const char *output_path);
 
 // Search and display functions
-void search_operator(int client_fd, const char *filename, const char *operator_name);
-void display_interoperator_billing_file(int client_fd, const char *filename);
+void search_operator(Conn *conn, const char *filename, const char *operator_name);
+void search_operator_table(Conn *conn, const OpTable *table, const OpNameIndex *index,
+                           const char *operator_name);
+void display_interoperator_billing_file(Conn *conn, const char *filename);
+
+// Operator table operations
+int intern_operator(OpTable *table, const char *operator_id, size_t id_len,
+                    const char *operator_name, size_t name_len);
+OpNode* get_or_create_opnode(OpTable *table, const char *operator_id, const char *operator_name);
+const char* operator_name_at(const OpTable *table, int index);
+int merge_op_table(OpTable *dst, OpTable *partial, int *remap);
+void free_op_table(OpTable *table);
+int format_operator_record(char *buf, size_t len, const OpNode *node);
 
-// Hash map operations
-unsigned long str_hash(const char *s);
-OpNode* get_or_create_opnode(const char *operator_id, const char *operator_name);
+// Operator name index: build over count names (entry i gets index i), look
+// up a search term, free. Lookup tries exact matches first (a numeric term
+// also matches the operator code), then prefix, then substring matches, and
+// stores the record indexes of the first tier that hits in ascending order.
+// Returns the number of matches.
+int op_name_index_build(OpNameIndex *idx, const char *const *names, const int *codes, int count);
+int op_name_index_build_table(OpNameIndex *idx, const OpTable *table);
+int op_name_index_lookup(const OpNameIndex *idx, const char *query, int *matches, int max);
+void op_name_index_free(OpNameIndex *idx);
 
 // Utility functions
 void chomp(char *s);
 int split_pipe(char *line, char **tokens, int max_tokens);
 long to_long_or_zero(const char *s);
 
-// Line processing
-void process_line(char *line);
+// Record processing; returns the record's operator index or -1 if skipped
+int intop_add_record(OpTable *table, const CdrRecord *rec);
+void process_line(OpTable *table, char *line);
 
 #endif // INTOPBILLPROCESS_H
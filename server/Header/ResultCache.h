@@ -0,0 +1,72 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+
+/* ============================================================
+   Constants
+   ============================================================ */
+#define RESULT_CACHE_DIR "Output/.cache"    // one subdirectory per input identity
+#define RESULT_CACHE_DEFAULT_MB 1024        // on-disk budget unless RESULT_CACHE_MB is set
+#define RESULT_CACHE_HASH_CHUNK (1 << 20)   // bytes read at a time while hashing
+#define RESULT_CACHE_HASH_SEED 14695981039346656037ULL  // hash state of an empty prefix
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+// Identity of a CDR input: equal keys mean byte-identical input, so the
+// billing results of one run are valid for every user
+typedef struct {
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;              // content hash of the whole file
+    char name[64];              // entry directory name under RESULT_CACHE_DIR
+} ResultCacheKey;
+
+// Hash state after the input prefix [0, offset). The hash runs over 8-byte
+// words from the start of the file, so it can resume at any multiple of 8.
+typedef struct {
+    uint64_t offset;            // 0 for none
+    uint64_t state;
+} ResultCacheMark;
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Compute the key of input. The content hash is remembered for an unchanged
+// file, so repeated lookups only stat it. Otherwise hashing resumes from
+// *mark, which must describe the current input (e.g. from a snapshot that
+// still applies), and *mark is moved to the state at limit rounded down to
+// a multiple of 8. The prefix before *mark is not read again, so the key
+// trusts it as far as the snapshot check does: an input that is only ever
+// appended to. mark may be NULL. Returns 0, or -1 when unreadable.
+int result_cache_key(const char *input, ResultCacheMark *mark, uint64_t limit,
+                     ResultCacheKey *key);
+
+// Whether input still has the size and mtime its key was computed from
+int result_cache_unchanged(const char *input, const ResultCacheKey *key);
+
+// Link the cached results for key into output_dir, replacing its reports
+// and snapshot. Returns 0 on a hit, -1 on a miss (output_dir untouched).
+int result_cache_fetch(const ResultCacheKey *key, const char *output_dir);
+
+// Add output_dir's results under key, then evict the least recently used
+// entries beyond the budget. Nothing is added unless every required file
+// was written at or after since, i.e. by the run that computed them.
+void result_cache_store(const ResultCacheKey *key, const char *output_dir,
+                        const struct timespec *since);
+
+#endif // RESULTCACHE_H
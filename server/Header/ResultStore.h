@@ -0,0 +1,54 @@
+#ifndef RESULTSTORE_H
+#define RESULTSTORE_H
+
+#include <pthread.h>
+#include <dirent.h>
+#include "BillingJob.h"
+
+/* ============================================================
+   Constants
+   ============================================================ */
+#define RESULT_OUTPUT_ROOT "Output"     // parent of every user's output directory
+#define RESULT_STORE_DEFAULT_MB 256     // resident budget unless RESULT_STORE_MB is set
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+// Aggregates of the latest billing run for one output directory, kept
+// resident so searches are answered without re-reading the text reports.
+// Published results are read-only; readers hold a reference while using one,
+// so an entry evicted or superseded meanwhile stays valid until released.
+typedef struct BillingResult {
+    char output_dir[256];
+    long records;               // CDR records the aggregates cover
+    CustomerTable customers;
+    OpTable operators;
+    OpNameIndex op_index;       // case-insensitive lookup over operators
+    size_t bytes;               // memory footprint charged to the budget
+    int refs;                   // store reference + active readers
+    struct BillingResult *next; // LRU order, most recent first
+} BillingResult;
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Load the snapshot of every directory under root. Returns how many loaded.
+int result_store_warm_start(const char *root);
+
+// Take over a finished job's aggregates as the latest result for its output
+// directory; the job's tables are left empty
+void result_store_publish(BillingJob *job);
+
+// Replace output_dir's result with its snapshot, after its files were
+// replaced on disk. Returns the records it covers, or -1 if it could not be
+// loaded, in which case the stale result is dropped all the same.
+long result_store_reload(const char *output_dir);
+
+// Latest result for output_dir with a reference held, or NULL. A result
+// that was evicted is reloaded from its snapshot.
+BillingResult* result_store_acquire(const char *output_dir);
+void result_store_release(BillingResult *result);
+
+#endif // RESULTSTORE_H
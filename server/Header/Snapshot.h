@@ -0,0 +1,76 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "BillingJob.h"
+
+/* ============================================================
+   Constants
+   ============================================================ */
+#define SNAPSHOT_FILE "billing.snap"        // kept in the job's output directory
+#define SNAPSHOT_MAGIC "CDRSNAP\n"          // 8 bytes
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_FINGERPRINT_BYTES 4096     // hashed at each end of the consumed prefix
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+// On-disk header. The aggregates that follow cover input bytes
+// [0, offset). The fingerprint detects a replaced or truncated input and
+// edits within SNAPSHOT_FINGERPRINT_BYTES of either end of the prefix; an
+// in-place edit elsewhere in it goes unnoticed, so only appends are safe.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t customerSize;      // sizeof(Customer), records are stored raw
+    char inputPath[256];
+    uint64_t inputDev;
+    uint64_t inputIno;
+    uint64_t offset;            // input bytes consumed, always a record boundary
+    uint64_t reportBytes;       // input the run's reports cover; past offset when
+                                // they include an unterminated last record
+    uint64_t headHash;          // first SNAPSHOT_FINGERPRINT_BYTES of the input
+    uint64_t tailHash;          // last SNAPSHOT_FINGERPRINT_BYTES before offset
+    uint64_t hashOffset;        // result cache hash state of input [0, hashOffset),
+    uint64_t hashState;         // hashOffset <= offset (see ResultCacheMark)
+    int64_t records;            // CDR records folded in so far
+    int64_t customerRecords;    // CustomerTable.totalRecords
+    uint64_t customerCount;
+    uint32_t operatorCount;
+    uint32_t reserved;
+} SnapshotHeader;
+
+// Operator entry, followed by nameLen bytes of name and idLen bytes of id
+typedef struct {
+    uint32_t idLen;
+    uint32_t nameLen;
+    int64_t stats[6];           // OperatorStats counters in declaration order
+} SnapshotOperator;
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Read and check only the header of the snapshot at path. Returns 0 on success.
+int snapshot_read_header(const char *path, SnapshotHeader *hdr);
+
+// Read a snapshot into empty tables without checking it against the input.
+// Returns 0 on success; on failure the tables are left empty.
+int snapshot_read(const char *path, SnapshotHeader *hdr,
+                  CustomerTable *customers, OpTable *operators);
+
+// Read the header of the snapshot at path and check that it was taken from
+// input's current contents with offset <= limit. Returns 0 when it applies.
+int snapshot_peek(const char *path, const char *input, size_t limit, SnapshotHeader *hdr);
+
+// Restore an empty job's aggregates from the snapshot at path if it was
+// taken from the job's current input file and offset <= limit. Returns the
+// input offset to resume from, or 0 (job left empty) when it does not apply.
+size_t snapshot_load(BillingJob *job, const char *path, size_t limit);
+
+// Persist the job's aggregates as covering input bytes [0, offset), for
+// reports that cover [0, report_bytes). Returns 0 on success.
+int snapshot_save(const BillingJob *job, const char *path, size_t offset, size_t report_bytes);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ============================================================
+   Constants
+   ============================================================ */
+#define ARENA_MIN_BLOCK (1UL << 20)   // first block size
+#define ARENA_MAX_BLOCK (64UL << 20)  // blocks double up to this size
+#define ARENA_ALIGN 64                // every allocation starts on a cache line
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;    // usable bytes in data
+    size_t used;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+} ArenaBlock;
+
+// Bump allocator for records that live exactly as long as a billing job.
+// Individual allocations are never freed; the whole arena is released at
+// once. A zeroed Arena is valid and empty. Not thread-safe: each ingest
+// worker allocates from its own table's arena.
+typedef struct Arena {
+    ArenaBlock *head;   // current block, older blocks follow
+    size_t reserved;    // total bytes held by all blocks
+} Arena;
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Allocate size bytes aligned to ARENA_ALIGN. Returns NULL when out of memory.
+void* arena_alloc(Arena *arena, size_t size);
+
+// Copy n bytes of s into the arena as a NUL-terminated string
+char* arena_strndup(Arena *arena, const char *s, size_t n);
+
+// Move every block of src into dst, leaving src empty
+void arena_adopt(Arena *dst, Arena *src);
+
+// Free every block at once
+void arena_release(Arena *arena);
+
+#endif // ARENA_H
@@ -5,10 +5,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>  // For isupper(), islower(), isdigit()
+#include <pthread.h>
  
 #define EMAIL_MAX 64
 #define PASS_MAX 32
 #define USER_FILE "data/user.txt"
+#define USER_BUCKETS_MIN 1024   // initial user directory buckets, a power of two
  
 // Authentication function declarations
 int is_valid_email(const char *email);
@@ -0,0 +1,34 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* ============================================================
+   Tunables (environment variables)
+   ============================================================ */
+#define CFG_INGEST_THREADS "CDR_INGEST_THREADS"  // worker threads per ingest, default: online CPUs / billing workers
+#define CFG_CDR_CACHE      "CDR_CACHE"           // 0 disables the binary CDR cache, default: 1
+#define CFG_INCREMENTAL    "CDR_INCREMENTAL"     // 0 rebuilds from scratch on every run, needed if the input is edited rather than only appended to, default: 1
+#define CFG_RESULT_STORE_MB "RESULT_STORE_MB"    // resident search results budget in MiB, default: 256
+#define CFG_RESULT_CACHE_MB "RESULT_CACHE_MB"    // results shared across users on disk in MiB; 0 disables, default: 1024
+#define CFG_BILLING_WORKERS "BILLING_WORKERS"    // CDR processing runs at once, default: online CPUs / ingest threads (4), at least 2
+#define CFG_BILLING_QUEUE  "BILLING_QUEUE_DEPTH" // runs waiting for a worker before refusing, default: 16
+#define CFG_MULTI_QUERY    "MULTI_QUERY"         // 1 keeps sessions open after each search and issues resume tokens, default: 0
+#define CFG_SESSION_TTL    "SESSION_TOKEN_TTL"   // seconds a resume token stays valid after last use, default: 3600
+#define CFG_EVENT_LOOPS    "EVENT_LOOPS"         // epoll threads serving clients; 0 = a thread per client, default: 0
+#define CFG_EVENT_WORKERS  "EVENT_WORKERS"       // threads for blocking client work in event mode, default: online CPUs
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Read a numeric tunable from the environment, falling back to def when it
+// is unset or not a number
+long config_long(const char *name, long def);
+
+// Number of online CPUs (at least 1)
+int config_online_cpus(void);
+
+#endif // CONFIG_H
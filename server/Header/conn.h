@@ -0,0 +1,121 @@
+#ifndef CONN_H
+#define CONN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* ============================================================
+   Constants
+   ============================================================ */
+#define CONN_BUFSIZE 16384      // bytes read from a client socket per recv()
+#define CONN_OUTSIZE 16384      // replies coalesced before a write is forced
+#define CONN_LINE_MAX 1024      // longest formatted line from send_linef()
+#define CONN_CAP_DEFLATE 0x1    // peer inflates "deflate" encoded downloads
+#define FRAME_HEADER 5          // type byte and 32-bit big-endian payload length
+
+// Frame types of the framed protocol
+enum {
+    FRAME_TEXT = 'T',           // reply text, whole lines; client input, one line
+    FRAME_PROMPT = 'P',         // the server waits for input: a PROMPT_* byte, then the text
+    FRAME_FILE = 'F',           // download starts: "<name>\n<size>\n<encoding>"
+    FRAME_DATA = 'D',           // a piece of the download
+    FRAME_END = 'E',            // download complete
+    FRAME_ERROR = 'X'           // a request failed
+};
+
+// What a prompt waits for, so framed clients never go by its wording
+enum {
+    PROMPT_LINE = 'L',          // one line
+    PROMPT_SECRET = 'S',        // one line, not to be echoed (passwords)
+    PROMPT_LIST = 'M'           // lines up to a lone "END" (batch search)
+};
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+// One client connection. Input is read in large chunks and handed out as
+// lines or raw byte ranges; output is collected and written with a single
+// writev() when the server waits for input, or earlier if the buffer fills.
+// Both buffers are allocated on first use and can be dropped while the
+// connection idles, so an idle connection costs only this struct.
+typedef struct {
+    int fd;
+    int failed;                 // a write failed: the peer is gone
+    int nonblocking;            // fd is non-blocking (event loop mode)
+    int caps;                   // CONN_CAP_* the peer announced
+    int framed;                 // both directions use frames instead of lines
+    size_t start;               // next unread byte in in
+    size_t end;                 // end of buffered input
+    size_t out_len;             // pending output bytes
+    char *in;                   // CONN_BUFSIZE bytes, or NULL
+    char *out;                  // CONN_OUTSIZE bytes, or NULL
+} Conn;
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+void conn_init(Conn *conn, int fd);
+
+// Release the buffers; the descriptor is left open
+void conn_destroy(Conn *conn);
+
+// Free the buffers if nothing is buffered in either direction
+void conn_trim(Conn *conn);
+
+// Switch the descriptor between blocking and non-blocking mode
+int conn_set_nonblocking(Conn *conn, int on);
+
+// Queue len bytes for the client (a FRAME_TEXT in frames mode). Returns 0,
+// or -1 once the connection failed.
+// On a non-blocking connection a client that stops reading until the buffer
+// overflows is treated as failed.
+int conn_write(Conn *conn, const void *buf, size_t len);
+
+// Queue s as one line: a newline is added unless s already ends with one
+int send_line(Conn *conn, const char *s);
+int send_linef(Conn *conn, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// A line asking for input of the given PROMPT_* kind, or reporting a failed
+// request. In frames mode they go out as FRAME_PROMPT and FRAME_ERROR;
+// otherwise as plain lines.
+int send_prompt(Conn *conn, int kind, const char *s);
+int send_error(Conn *conn, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Queue one frame of the given type. conn_frame_header() queues only the
+// header, for a payload the caller sends itself.
+int conn_write_frame(Conn *conn, int type, const void *buf, size_t len);
+int conn_frame_header(Conn *conn, int type, size_t len);
+
+// Write out everything queued. Returns 0 on success. On a non-blocking
+// connection returns 1 if output is still pending because the socket is full.
+int conn_flush(Conn *conn);
+
+// Read whatever the socket has into the input buffer without waiting for a
+// full line. Returns bytes read, 0 on close, -1 on error or (non-blocking)
+// with errno EAGAIN when nothing is available.
+ssize_t conn_fill(Conn *conn);
+
+// Take the next buffered line without its "\r\n", if a whole line (or
+// bufsize-1 bytes of one) is already buffered. Returns its length, or -1.
+// In frames mode each FRAME_TEXT is one line; other frames are skipped.
+ssize_t conn_take_line(Conn *conn, char *buf, size_t bufsize);
+
+// Next line without its "\r\n"; longer lines are returned in bufsize-1 pieces.
+// Pending output is flushed first. Returns the length, or -1 when the
+// connection closed or failed.
+ssize_t recv_line(Conn *conn, char *buf, size_t bufsize);
+
+// Up to len raw bytes, buffered input first. Returns 0 on close, -1 on error.
+ssize_t conn_read(Conn *conn, void *dst, size_t len);
+
+#endif // CONN_H
@@ -0,0 +1,34 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "session.h"
+
+/* ============================================================
+   Constants
+   ============================================================ */
+#define EVENT_BATCH 256         // events taken per epoll_wait()
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Start nloops epoll threads multiplexing the menu sessions and nworkers
+// threads for their blocking actions (processing, searches, downloads).
+// Sessions following a billing job stay on their loop. Returns 0 on success.
+int event_server_start(int nloops, int nworkers);
+
+// Hand an accepted connection to one of the loops. Returns 0 on success;
+// on failure the descriptor is closed.
+int event_server_add(int fd);
+
+#endif // EVENTLOOP_H
@@ -0,0 +1,36 @@
+#ifndef OUTFILE_H
+#define OUTFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+// Report file written under a unique temporary name and renamed into place,
+// so concurrent jobs never interleave and readers never see a partial file
+typedef struct {
+    FILE *fp;
+    char path[512];
+    char tmp_path[520];
+} OutFile;
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Open a temporary file next to path. Returns the stream, or NULL on error.
+FILE* outfile_open(OutFile *of, const char *path);
+
+// Close the stream and atomically replace path. Returns 0 on success.
+int outfile_commit(OutFile *of);
+
+// Close the stream and discard the temporary file
+void outfile_abort(OutFile *of);
+
+#endif // OUTFILE_H
@@ -9,23 +9,96 @@
 #include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include "conn.h"
 #include "CustBillProcess.h"
 #include "IntopBillProcess.h"
+#include "BillingJob.h"
+#include "CdrCache.h"
+#include "Snapshot.h"
+#include "ResultStore.h"
+#include "ResultCache.h"
+#include "config.h"
 
 /* ============================================================
    Constants
    ============================================================ */
 #define BUFSIZE 1024
+#define BILLING_DEFAULT_WORKERS 2   // fewest concurrent runs unless BILLING_WORKERS is set
+#define BILLING_CORES_PER_RUN 4     // cores each run ingests on by default
+#define BILLING_DEFAULT_QUEUE 16    // waiting runs unless BILLING_QUEUE_DEPTH is set
+#define BILLING_JOB_HISTORY 64      // finished runs kept for status queries
+#define BILLING_PROGRESS_MS 1000    // progress line interval while following a run
+#define BILLING_STATUS_MAX 256      // longest status line
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+typedef enum {
+    BILLING_QUEUED,
+    BILLING_RUNNING,
+    BILLING_DONE
+} BillingState;
+
+// Outcome of a run
+enum {
+    BILLING_OK,
+    BILLING_ERR_MEMORY,
+    BILLING_ERR_INPUT,
+    BILLING_ERR_OPERATORS,          // more than OP_MAX_OPERATORS operator ids
+    BILLING_ERR_OUTPUT              // a report could not be written
+};
+
+// Point-in-time copy of a run's progress
+typedef struct {
+    unsigned long id;
+    BillingState state;
+    int status;                     // BILLING_OK or an error, once done
+    int cached;                     // results reused from the result cache
+    int position;                   // queue position while queued, 0 if about to start
+    const char *phase;              // while running
+    long records;                   // records read so far
+    size_t bytes;                   // input bytes consumed so far
+    size_t input_bytes;             // input this run reads, 0 if unknown
+    double elapsed;                 // seconds since the run started
+} BillingJobStatus;
 
 /* ============================================================
    Function Declarations
    ============================================================ */
 
-// Socket communication helpers
-int sendall_fd(int sock, const char *buf, size_t len);
-int send_line_fd(int sock, const char *s);
+// Queue a run for output_dir on the billing pool. Returns its job ID, or 0
+// when the queue is full.
+unsigned long billing_pool_submit(const char *output_dir);
+
+// Status of job id, or of the latest job when id is 0, if it belongs to
+// output_dir. Returns 0, or -1 when there is no such job.
+int billing_pool_status(const char *output_dir, unsigned long id, BillingJobStatus *st);
+
+// Wait up to timeout_ms for any job to make progress
+void billing_pool_wait(int timeout_ms);
+
+// Have listener called whenever a job is taken, changes phase or finishes,
+// for waiters that cannot block on the pool. It runs with the pool lock
+// held and must not block.
+void billing_pool_listen(void (*listener)(void));
+
+// One status line, e.g. "Job 3: running (reading CDRs), ..."
+void billing_status_format(const BillingJobStatus *st, char *buf, size_t len);
+
+// Submit a run for the client and reply with its job ID; the run continues
+// in the background
+int processCDRdata(Conn *conn, const char *output_dir);
+
+// Send a progress line for job id (0 = latest) whenever it changes, until
+// the run is done. Returns -1 when there is no such job.
+int follow_billing_job(Conn *conn, const char *output_dir, unsigned long id);
 
-// Main CDR processing function
-int processCDRdata(int client_fd, const char *output_dir);
+// One non-blocking round of the above: queue the status line of job *id
+// (0 = latest, resolved in place) unless it equals last, which is updated.
+// Returns 1 while the run goes on, 0 once it is done, -1 if there is no
+// such job.
+int follow_billing_step(Conn *conn, const char *output_dir, unsigned long *id,
+                        char *last, size_t len);
 
 #endif // PROCESS_H
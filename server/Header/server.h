@@ -14,16 +14,21 @@
 #include <arpa/inet.h>
 #include <ctype.h>
 #include <pthread.h>
+#include "conn.h"
+#include "session.h"
+#include "eventloop.h"
+#include "config.h"
 #include "process.h"
 #include "auth.h"
 #include "CustBillProcess.h"
 #include "IntopBillProcess.h"
+#include "ResultStore.h"
 
 /* ============================================================
    Constants
    ============================================================ */
 #define PORT 12345
-#define BACKLOG 5
+#define BACKLOG SOMAXCONN
 #define BUFSIZE 1024
 
 /* ============================================================
@@ -36,24 +41,10 @@ typedef struct {
     struct sockaddr_in client_addr;
 } ClientInfo;
 
-// Menu states
-typedef enum {
-    MAIN,
-    SECOND,
-    BILLING,
-    CUST_BILL,
-    INTER_BILL
-} MenuState;
-
 /* ============================================================
    Function Declarations
    ============================================================ */
 
-// Socket communication helpers
-int sendall(int sock, const char *buf, size_t len);
-int send_line(int sock, const char *s);
-ssize_t recv_line(int sock, char *buf, size_t bufsize);
-
 // Client handling
 void* client_thread(void* arg);
 void handle_client(int client_fd);
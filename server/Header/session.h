@@ -0,0 +1,115 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+#include "conn.h"
+#include "auth.h"
+#include "process.h"
+#include "ResultStore.h"
+
+/* ============================================================
+   Constants
+   ============================================================ */
+#define SESSION_INPUT_MAX 1024  // longest input line taken from a client
+#define SESSION_TOKEN_BYTES 16  // random bytes in a resume token, sent as hex
+#define SESSION_TOKEN_TTL 3600  // seconds unless SESSION_TOKEN_TTL is set
+#define SESSION_TOKEN_MAX 4096  // live tokens kept; the oldest is dropped beyond
+#define SESSION_BATCH_MAX 100000    // MSISDNs taken in one batch search
+#define SESSION_BATCH_END "END"     // line that ends a batch upload
+#define SESSION_FRAMES_ON "FRAMES_ON" // last text line before a switch to frames
+
+/* ============================================================
+   Data Structures
+   ============================================================ */
+
+// Menu states
+typedef enum {
+    MAIN,
+    SECOND,
+    BILLING,
+    CUST_BILL,
+    INTER_BILL
+} MenuState;
+
+// What the next input line answers
+typedef enum {
+    STEP_CHOICE,            // the current menu's "Enter choice"
+    STEP_SIGNUP_EMAIL,
+    STEP_SIGNUP_PASSWORD,
+    STEP_LOGIN_EMAIL,
+    STEP_LOGIN_PASSWORD,
+    STEP_MSISDN,
+    STEP_OPERATOR,
+    STEP_JOB_STATUS,        // job ID to report on
+    STEP_JOB_FOLLOW,        // job ID to follow
+    STEP_RESUME_TOKEN,      // token of an earlier session
+    STEP_BATCH_MSISDN       // one MSISDN of a batch upload, or its end
+} SessionStep;
+
+// Work that may block on disk or run for long; the caller runs it with
+// session_run_action() where blocking is acceptable
+typedef enum {
+    ACTION_NONE,
+    ACTION_PROCESS,         // processCDRdata
+    ACTION_SEARCH_MSISDN,
+    ACTION_DISPLAY_CB,
+    ACTION_SEARCH_OPERATOR,
+    ACTION_DISPLAY_IOSB,
+    ACTION_FOLLOW_JOB,      // streams progress until the run is done
+    ACTION_BATCH_MSISDN
+} SessionAction;
+
+// One client's menu session. Input is fed one line at a time, so the same
+// state machine serves a dedicated thread or an event loop.
+typedef struct Session {
+    Conn conn;
+    MenuState state;
+    SessionStep step;
+    int connected;                      // cleared when the session should end
+    char logged_in_user[EMAIL_MAX];
+    char user_output_dir[256];          // Output/<sanitized email>
+    char email[EMAIL_MAX];              // entered, awaiting its password
+    int multi_query;                    // stay connected after searches
+    char token[SESSION_TOKEN_BYTES * 2 + 1];    // resume token, if issued
+    SessionAction action;               // pending blocking work
+    char arg[SESSION_INPUT_MAX];        // its argument
+    long *batch;                        // uploaded MSISDNs, in order
+    size_t batch_count;
+    size_t batch_capacity;
+    size_t batch_skipped;               // invalid or over the limit
+    int loop_fd;                        // owning epoll instance in event mode
+    struct Session *next;               // worker queue or follower link in event mode
+    int following;                      // event mode: waiting on a job's progress
+    unsigned long follow_id;            // that job
+    char follow_line[BILLING_STATUS_MAX];   // its last status line sent
+} Session;
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Start a session on fd and queue the main menu
+void session_init(Session *s, int fd);
+void session_destroy(Session *s);
+
+// Handle one input line. Replies are queued on s->conn; blocking work is
+// left in s->action for the caller to run.
+void session_input(Session *s, const char *line);
+
+// Run and clear the pending action, then queue what follows it
+void session_run_action(Session *s);
+
+// ACTION_FOLLOW_JOB for an event loop, which cannot block: clear the action
+// and queue the job's status. Further lines come from session_follow_poll()
+// whenever the pool reports progress. Both return 1 while the session keeps
+// following, and 0 once the run is over and the menu has been queued.
+int session_follow_start(Session *s);
+int session_follow_poll(Session *s);
+
+#endif // SESSION_H
@@ -0,0 +1,46 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <zlib.h>
+#include "conn.h"
+
+/* ============================================================
+   Constants
+   ============================================================ */
+#define TRANSFER_CHUNK (1 << 30)        // largest single sendfile() call
+#define TRANSFER_DEFLATE_CHUNK (256 << 10)  // file bytes compressed per step
+#define TRANSFER_DEFLATE_LEVEL 6
+#define TRANSFER_FRAME_CHUNK (4 << 20)  // file bytes per frame in frames mode
+
+/* ============================================================
+   Function Declarations
+   ============================================================ */
+
+// Send len bytes of fd starting at offset after any queued output, copying
+// in the kernel with sendfile(). Partial writes are resumed. In frames mode
+// the bytes go out as FRAME_TEXT frames. Returns 0 on success.
+int send_file_range(Conn *conn, int fd, off_t offset, size_t len);
+
+// Download a report: FILE_TRANSFER_START:<name>, FILE_SIZE:<bytes>, the raw
+// file and FILE_TRANSFER_COMPLETE. A peer with CONN_CAP_DEFLATE instead gets
+// FILE_ENCODING:deflate before FILE_SIZE and the file as one zlib stream in
+// "FILE_CHUNK:<n>" framed pieces, ended by FILE_CHUNK:0. In frames mode it
+// is a FRAME_FILE ("<name>\n<size>\n<identity|deflate>"), FRAME_DATA frames
+// of the raw or compressed bytes, and an empty FRAME_END. Returns 0 on
+// success, -1 with errno set if the file cannot be opened (nothing sent),
+// -2 if the transfer failed.
+int send_report_file(Conn *conn, const char *path, const char *name);
+
+#endif // TRANSFER_H
@@ -0,0 +1,456 @@
+// CdrCache.c - Binary columnar cache of the CDR text file
+// A full parallel read of the text also stores every field as a typed column,
+// one range per ingest slice, so later billing runs read fixed-width arrays
+// instead of decoding text.
+// Values are stored in native byte order; the cache is a local artefact.
+#include "../Header/CdrCache.h"
+#include "../Header/config.h"
+#include "../Header/outfile.h"
+
+static const size_t column_width[CDR_NUM_COLUMNS] = {
+    [CDR_COL_MSISDN]     = sizeof(int64_t),
+    [CDR_COL_OP_CODE]    = sizeof(int32_t),
+    [CDR_COL_OP_NAME]    = sizeof(uint16_t),
+    [CDR_COL_CALL_TYPE]  = sizeof(uint8_t),
+    [CDR_COL_DURATION]   = sizeof(float),
+    [CDR_COL_DOWNLOAD]   = sizeof(float),
+    [CDR_COL_UPLOAD]     = sizeof(float),
+    [CDR_COL_TP_MSISDN]  = sizeof(int64_t),
+    [CDR_COL_TP_OP_CODE] = sizeof(int32_t),
+    [CDR_COL_FLAGS]      = sizeof(uint8_t),
+    [CDR_COL_DURATION_UNITS] = sizeof(int64_t),
+    [CDR_COL_DOWNLOAD_UNITS] = sizeof(int64_t),
+    [CDR_COL_UPLOAD_UNITS]   = sizeof(int64_t),
+};
+
+static uint64_t align_up(uint64_t v)
+{
+    return (v + CDR_CACHE_ALIGN - 1) & ~(uint64_t)(CDR_CACHE_ALIGN - 1);
+}
+
+int cdr_cache_path(const char *filename, char *out, size_t outlen)
+{
+    int n = snprintf(out, outlen, "%s%s", filename, CDR_CACHE_SUFFIX);
+    return (n < 0 || (size_t)n >= outlen) ? -1 : 0;
+}
+
+/* ============================================================
+   Reader
+   ============================================================ */
+
+static int cache_matches_source(const CdrCacheHeader *hdr, const struct stat *src)
+{
+    return hdr->sourceSize == (uint64_t)src->st_size &&
+           hdr->sourceMtimeSec == (int64_t)src->st_mtim.tv_sec &&
+           hdr->sourceMtimeNsec == (int64_t)src->st_mtim.tv_nsec;
+}
+
+// Check that every column and the dictionary lie inside the mapping
+static int cache_layout_valid(const CdrCacheHeader *hdr, size_t size)
+{
+    if (memcmp(hdr->magic, CDR_CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != CDR_CACHE_VERSION ||
+        hdr->headerSize != sizeof(CdrCacheHeader))
+        return 0;
+
+    for (int c = 0; c < CDR_NUM_COLUMNS; c++) {
+        uint64_t off = hdr->columnOffset[c];
+        if (off % CDR_CACHE_ALIGN != 0 || off > size ||
+            hdr->records > (size - off) / column_width[c])
+            return 0;
+    }
+
+    if (hdr->namesOffset % CDR_CACHE_ALIGN != 0 || hdr->namesOffset > size ||
+        hdr->nameCount > (size - hdr->namesOffset) / sizeof(CdrCacheName) ||
+        hdr->blobOffset > size || hdr->blobSize > size - hdr->blobOffset)
+        return 0;
+
+    const CdrCacheName *names = (const CdrCacheName *)((const char *)hdr + hdr->namesOffset);
+    for (uint32_t i = 0; i < hdr->nameCount; i++) {
+        if ((uint64_t)names[i].offset + names[i].nameLen + names[i].idLen > hdr->blobSize)
+            return 0;
+    }
+    return 1;
+}
+
+int cdr_cache_open(const char *filename, CdrCache *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    if (!config_long(CFG_CDR_CACHE, 1)) return -1;
+
+    char path[512];
+    struct stat src, st;
+    if (cdr_cache_path(filename, path, sizeof(path)) != 0 || stat(filename, &src) != 0)
+        return -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (size_t)st.st_size < sizeof(CdrCacheHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return -1;
+
+    const CdrCacheHeader *hdr = (const CdrCacheHeader *)m;
+    if (!cache_layout_valid(hdr, (size_t)st.st_size) || !cache_matches_source(hdr, &src)) {
+        munmap(m, (size_t)st.st_size);
+        return -1;
+    }
+
+    const unsigned char *base = (const unsigned char *)m;
+    cache->map = base;
+    cache->size = (size_t)st.st_size;
+    cache->sourceSize = (size_t)hdr->sourceSize;
+    cache->records = (size_t)hdr->records;
+    cache->msisdn = (const int64_t *)(base + hdr->columnOffset[CDR_COL_MSISDN]);
+    cache->opCode = (const int32_t *)(base + hdr->columnOffset[CDR_COL_OP_CODE]);
+    cache->opName = (const uint16_t *)(base + hdr->columnOffset[CDR_COL_OP_NAME]);
+    cache->callType = base + hdr->columnOffset[CDR_COL_CALL_TYPE];
+    cache->duration = (const float *)(base + hdr->columnOffset[CDR_COL_DURATION]);
+    cache->download = (const float *)(base + hdr->columnOffset[CDR_COL_DOWNLOAD]);
+    cache->upload = (const float *)(base + hdr->columnOffset[CDR_COL_UPLOAD]);
+    cache->tpMsisdn = (const int64_t *)(base + hdr->columnOffset[CDR_COL_TP_MSISDN]);
+    cache->tpOpCode = (const int32_t *)(base + hdr->columnOffset[CDR_COL_TP_OP_CODE]);
+    cache->flags = base + hdr->columnOffset[CDR_COL_FLAGS];
+    cache->durationUnits = (const int64_t *)(base + hdr->columnOffset[CDR_COL_DURATION_UNITS]);
+    cache->downloadUnits = (const int64_t *)(base + hdr->columnOffset[CDR_COL_DOWNLOAD_UNITS]);
+    cache->uploadUnits = (const int64_t *)(base + hdr->columnOffset[CDR_COL_UPLOAD_UNITS]);
+    cache->names = (const CdrCacheName *)(base + hdr->namesOffset);
+    cache->nameCount = hdr->nameCount;
+    cache->blob = (const char *)(base + hdr->blobOffset);
+
+    madvise(m, cache->size, MADV_WILLNEED);
+    return 0;
+}
+
+void cdr_cache_close(CdrCache *cache)
+{
+    if (cache->map)
+        munmap((void *)cache->map, cache->size);
+    memset(cache, 0, sizeof(*cache));
+}
+
+long cdr_cache_ingest(const CdrCache *cache, size_t begin, size_t end, CdrSink sink, void *ctx)
+{
+    if (end > cache->records) end = cache->records;
+
+    CdrRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    for (size_t i = begin; i < end; i++) {
+        uint16_t n = cache->opName[i];
+        if (n < cache->nameCount) {
+            const CdrCacheName *name = &cache->names[n];
+            rec.operatorName = cache->blob + name->offset;
+            rec.operatorNameLen = name->nameLen;
+            rec.operatorId = rec.operatorName + name->nameLen;
+            rec.operatorIdLen = name->idLen;
+        } else {
+            rec.operatorName = rec.operatorId = "";
+            rec.operatorNameLen = rec.operatorIdLen = 0;
+        }
+        rec.msisdn = (long)cache->msisdn[i];
+        rec.operatorCode = cache->opCode[i];
+        rec.callType = (CallType)cache->callType[i];
+        rec.callTypeExact = (cache->flags[i] & CDR_FLAG_EXACT_CALL_TYPE) != 0;
+        rec.duration = cache->duration[i];
+        rec.download = cache->download[i];
+        rec.upload = cache->upload[i];
+        rec.durationUnits = (long)cache->durationUnits[i];
+        rec.downloadUnits = (long)cache->downloadUnits[i];
+        rec.uploadUnits = (long)cache->uploadUnits[i];
+        rec.thirdPartyMsisdn = (long)cache->tpMsisdn[i];
+        rec.thirdPartyOpCode = cache->tpOpCode[i];
+        rec.complete = cache->flags[i] & CDR_FLAG_COMPLETE;
+        sink(&rec, ctx);
+    }
+    return (long)(end - begin);
+}
+
+/* ============================================================
+   Converter
+   ============================================================ */
+
+// Column writer for one slice of the text file. Operator name and id text
+// pairs are deduplicated into the slice's dictionary through a small
+// open-addressing table; the columns grow as records arrive.
+struct CdrCacheWriter {
+    unsigned char *col[CDR_NUM_COLUMNS];
+    size_t records;
+    size_t capacity;
+    CdrCacheName *names;
+    uint32_t nameCount;
+    uint32_t nameCapacity;
+    uint32_t *slots;            // name index + 1, 0 = empty
+    uint32_t slotMask;
+    char *blob;
+    size_t blobSize;
+    size_t blobCapacity;
+    int failed;
+};
+
+static uint32_t name_hash(const char *name, int nameLen, const char *id, int idLen)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < nameLen; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    h = (h ^ '|') * 16777619u;
+    for (int i = 0; i < idLen; i++)
+        h = (h ^ (unsigned char)id[i]) * 16777619u;
+    return h;
+}
+
+static int name_equals(const CdrCacheWriter *w, uint32_t index,
+                       const char *name, int nameLen, const char *id, int idLen)
+{
+    const CdrCacheName *e = &w->names[index];
+    const char *text = w->blob + e->offset;
+    return e->nameLen == nameLen && e->idLen == idLen &&
+           memcmp(text, name, e->nameLen) == 0 &&
+           memcmp(text + e->nameLen, id, e->idLen) == 0;
+}
+
+static int grow_names(CdrCacheWriter *w)
+{
+    uint32_t capacity = w->nameCapacity ? w->nameCapacity * 2 : 64;
+    CdrCacheName *names = (CdrCacheName *)realloc(w->names, capacity * sizeof(CdrCacheName));
+    if (!names) return -1;
+    w->names = names;
+    w->nameCapacity = capacity;
+
+    uint32_t nslots = capacity * 2;
+    uint32_t *slots = (uint32_t *)calloc(nslots, sizeof(uint32_t));
+    if (!slots) return -1;
+    free(w->slots);
+    w->slots = slots;
+    w->slotMask = nslots - 1;
+
+    for (uint32_t n = 0; n < w->nameCount; n++) {
+        const CdrCacheName *e = &w->names[n];
+        const char *text = w->blob + e->offset;
+        uint32_t i = name_hash(text, e->nameLen, text + e->nameLen, e->idLen) & w->slotMask;
+        while (slots[i])
+            i = (i + 1) & w->slotMask;
+        slots[i] = n + 1;
+    }
+    return 0;
+}
+
+// Dictionary index of an operator name and id text pair, or -1
+static int intern_name(CdrCacheWriter *w, const char *name, int nameLen, const char *id, int idLen)
+{
+    if (nameLen > UINT16_MAX || idLen > UINT16_MAX)
+        return -1;
+
+    uint32_t h = name_hash(name, nameLen, id, idLen);
+    if (w->nameCapacity) {
+        uint32_t i = h & w->slotMask;
+        while (w->slots[i]) {
+            if (name_equals(w, w->slots[i] - 1, name, nameLen, id, idLen))
+                return (int)(w->slots[i] - 1);
+            i = (i + 1) & w->slotMask;
+        }
+    }
+
+    if (w->nameCount >= CDR_CACHE_MAX_NAMES) return -1;
+    if (w->nameCount == w->nameCapacity && grow_names(w) != 0) return -1;
+
+    size_t len = (size_t)nameLen + (size_t)idLen;
+    if (w->blobSize + len > w->blobCapacity) {
+        size_t capacity = w->blobCapacity ? w->blobCapacity * 2 : 4096;
+        while (capacity < w->blobSize + len)
+            capacity *= 2;
+        if (capacity > UINT32_MAX) return -1;
+        char *blob = (char *)realloc(w->blob, capacity);
+        if (!blob) return -1;
+        w->blob = blob;
+        w->blobCapacity = capacity;
+    }
+
+    CdrCacheName *e = &w->names[w->nameCount];
+    e->offset = (uint32_t)w->blobSize;
+    e->nameLen = (uint16_t)nameLen;
+    e->idLen = (uint16_t)idLen;
+    memcpy(w->blob + w->blobSize, name, (size_t)nameLen);
+    memcpy(w->blob + w->blobSize + nameLen, id, (size_t)idLen);
+    w->blobSize += len;
+
+    uint32_t i = h & w->slotMask;
+    while (w->slots[i])
+        i = (i + 1) & w->slotMask;
+    w->slots[i] = w->nameCount + 1;
+    return (int)w->nameCount++;
+}
+
+static int grow_columns(CdrCacheWriter *w, size_t capacity)
+{
+    for (int c = 0; c < CDR_NUM_COLUMNS; c++) {
+        unsigned char *col = (unsigned char *)realloc(w->col[c], capacity * column_width[c]);
+        if (!col) return -1;
+        w->col[c] = col;
+    }
+    w->capacity = capacity;
+    return 0;
+}
+
+CdrCacheWriter *cdr_cache_writer_new(size_t expected)
+{
+    CdrCacheWriter *w = (CdrCacheWriter *)calloc(1, sizeof(CdrCacheWriter));
+    if (w && grow_columns(w, expected ? expected : 1) != 0) {
+        cdr_cache_writer_free(w);
+        return NULL;
+    }
+    return w;
+}
+
+void cdr_cache_writer_free(CdrCacheWriter *w)
+{
+    if (!w) return;
+    for (int c = 0; c < CDR_NUM_COLUMNS; c++)
+        free(w->col[c]);
+    free(w->names);
+    free(w->slots);
+    free(w->blob);
+    free(w);
+}
+
+void cdr_cache_writer_add(CdrCacheWriter *w, const CdrRecord *rec)
+{
+    if (w->failed) return;
+    if (w->records == w->capacity && grow_columns(w, w->capacity * 2) != 0) {
+        w->failed = 1;
+        return;
+    }
+
+    int name = intern_name(w, rec->operatorName, rec->operatorNameLen,
+                           rec->operatorId, rec->operatorIdLen);
+    if (name < 0) {
+        w->failed = 1;
+        return;
+    }
+
+    size_t i = w->records++;
+    ((int64_t *)w->col[CDR_COL_MSISDN])[i] = rec->msisdn;
+    ((int32_t *)w->col[CDR_COL_OP_CODE])[i] = rec->operatorCode;
+    ((uint16_t *)w->col[CDR_COL_OP_NAME])[i] = (uint16_t)name;
+    w->col[CDR_COL_CALL_TYPE][i] = (uint8_t)rec->callType;
+    ((float *)w->col[CDR_COL_DURATION])[i] = rec->duration;
+    ((float *)w->col[CDR_COL_DOWNLOAD])[i] = rec->download;
+    ((float *)w->col[CDR_COL_UPLOAD])[i] = rec->upload;
+    ((int64_t *)w->col[CDR_COL_TP_MSISDN])[i] = rec->thirdPartyMsisdn;
+    ((int32_t *)w->col[CDR_COL_TP_OP_CODE])[i] = rec->thirdPartyOpCode;
+    w->col[CDR_COL_FLAGS][i] = (rec->complete ? CDR_FLAG_COMPLETE : 0) |
+                               (rec->callTypeExact ? CDR_FLAG_EXACT_CALL_TYPE : 0);
+    ((int64_t *)w->col[CDR_COL_DURATION_UNITS])[i] = rec->durationUnits;
+    ((int64_t *)w->col[CDR_COL_DOWNLOAD_UNITS])[i] = rec->downloadUnits;
+    ((int64_t *)w->col[CDR_COL_UPLOAD_UNITS])[i] = rec->uploadUnits;
+}
+
+static int pwrite_all(int fd, const void *buf, size_t len, off_t off)
+{
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        off += n;
+    }
+    return 0;
+}
+
+// Fold every slice dictionary into dict and rewrite the slice's name column
+// with the merged indexes
+static int merge_names(CdrCacheWriter *dict, CdrCacheWriter **slices, int nslices)
+{
+    uint16_t remap[CDR_CACHE_MAX_NAMES];
+    for (int s = 0; s < nslices; s++) {
+        CdrCacheWriter *w = slices[s];
+        for (uint32_t n = 0; n < w->nameCount; n++) {
+            const CdrCacheName *e = &w->names[n];
+            const char *text = w->blob + e->offset;
+            int index = intern_name(dict, text, e->nameLen, text + e->nameLen, e->idLen);
+            if (index < 0) return -1;
+            remap[n] = (uint16_t)index;
+        }
+
+        uint16_t *col = (uint16_t *)w->col[CDR_COL_OP_NAME];
+        for (size_t i = 0; i < w->records; i++)
+            col[i] = remap[col[i]];
+    }
+    return 0;
+}
+
+int cdr_cache_write(const char *filename, const struct stat *src,
+                    CdrCacheWriter **slices, int nslices)
+{
+    char path[512];
+    if (cdr_cache_path(filename, path, sizeof(path)) != 0) return -1;
+
+    CdrCacheHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CDR_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = CDR_CACHE_VERSION;
+    hdr.headerSize = sizeof(CdrCacheHeader);
+    hdr.sourceSize = (uint64_t)src->st_size;
+    hdr.sourceMtimeSec = (int64_t)src->st_mtim.tv_sec;
+    hdr.sourceMtimeNsec = (int64_t)src->st_mtim.tv_nsec;
+    for (int s = 0; s < nslices; s++) {
+        if (slices[s]->failed) return -1;
+        hdr.records += slices[s]->records;
+    }
+
+    CdrCacheWriter dict;
+    memset(&dict, 0, sizeof(dict));
+    int rc = -1;
+    if (merge_names(&dict, slices, nslices) != 0) goto done;
+
+    uint64_t offset = align_up(sizeof(CdrCacheHeader));
+    for (int c = 0; c < CDR_NUM_COLUMNS; c++) {
+        hdr.columnOffset[c] = offset;
+        offset = align_up(offset + hdr.records * column_width[c]);
+    }
+    hdr.nameCount = dict.nameCount;
+    hdr.namesOffset = offset;
+    hdr.blobOffset = offset + (uint64_t)dict.nameCount * sizeof(CdrCacheName);
+    hdr.blobSize = dict.blobSize;
+
+    OutFile out;
+    FILE *fp = outfile_open(&out, path);
+    if (!fp) goto done;
+    int fd = fileno(fp);
+
+    // Each column is the slices' ranges back to back, in file order
+    int failed = 0;
+    for (int c = 0; c < CDR_NUM_COLUMNS && !failed; c++) {
+        off_t pos = (off_t)hdr.columnOffset[c];
+        for (int s = 0; s < nslices && !failed; s++) {
+            size_t len = slices[s]->records * column_width[c];
+            failed = pwrite_all(fd, slices[s]->col[c], len, pos) != 0;
+            pos += (off_t)len;
+        }
+    }
+
+    // Header goes last so a torn write can never look valid
+    if (failed ||
+        pwrite_all(fd, dict.names, (size_t)dict.nameCount * sizeof(CdrCacheName), (off_t)hdr.namesOffset) != 0 ||
+        pwrite_all(fd, dict.blob, dict.blobSize, (off_t)hdr.blobOffset) != 0 ||
+        pwrite_all(fd, &hdr, sizeof(hdr), 0) != 0) {
+        fprintf(stderr, "Error writing CDR cache '%s'\n", path);
+        outfile_abort(&out);
+        goto done;
+    }
+    rc = outfile_commit(&out);
+
+done:
+    free(dict.names);
+    free(dict.slots);
+    free(dict.blob);
+    return rc;
+}
@@ -0,0 +1,663 @@
+// CdrIngest.c - Single-pass CDR reader and record decoder
+// The CDR file is memory-mapped and every record is decoded straight out of
+// the mapping in one walk, then handed to a sink which feeds both the
+// customer and the interoperator aggregators. An up-to-date binary cache
+// (see CdrCache.c) is read instead of the text whenever one exists, and a
+// full parallel read of the text writes that cache on the way.
+#include "../Header/CdrIngest.h"
+#include "../Header/CdrCache.h"
+#include "../Header/config.h"
+
+/* ============================================================
+   Field Cursor
+   ============================================================ */
+
+// Walks the fields of one record; eol is set once the last field was consumed
+typedef struct {
+    const char *p;
+    const char *end;
+    int eol;
+} FieldCursor;
+
+// Spaces and tabs around a number are padding, as they were to sscanf()
+static const char *skip_blanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+// Step over the '|' that terminates the current field, or mark end of line.
+// Anything but blanks left before the separator makes the field invalid.
+static int next_field(FieldCursor *c)
+{
+    int clean = 1;
+    c->p = skip_blanks(c->p, c->end);
+    if (c->p < c->end && *c->p != '|') {
+        const char *sep = memchr(c->p, '|', (size_t)(c->end - c->p));
+        c->p = sep ? sep : c->end;
+        clean = 0;
+    }
+    if (c->p < c->end) c->p++;
+    else c->eol = 1;
+    return clean;
+}
+
+static int take_string(FieldCursor *c, const char **out, int *len)
+{
+    if (c->eol) {
+        *out = "";
+        *len = 0;
+        return 0;
+    }
+    const char *start = c->p;
+    const char *sep = memchr(start, '|', (size_t)(c->end - start));
+    c->p = sep ? sep : c->end;
+    *out = start;
+    *len = (int)(c->p - start);
+    next_field(c);
+    return *len > 0;
+}
+
+static int take_long(FieldCursor *c, long *out)
+{
+    if (c->eol) return 0;
+
+    const char *p = skip_blanks(c->p, c->end);
+    int neg = 0;
+    if (p < c->end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    const char *digits = p;
+    long v = 0;
+    while (p < c->end && (unsigned)(*p - '0') < 10)
+        v = v * 10 + (*p++ - '0');
+
+    int ok = (p > digits);
+    *out = neg ? -v : v;
+    c->p = p;
+    return next_field(c) && ok;
+}
+
+static const double pow10_neg[] = {
+    1.0, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9,
+    1e-10, 1e-11, 1e-12, 1e-13, 1e-14, 1e-15, 1e-16, 1e-17, 1e-18
+};
+
+// Fixed-point decimal like "150.25"; exponents and overlong mantissas fall
+// back to strtof on a bounded copy of the field.
+static int take_decimal(FieldCursor *c, float *out)
+{
+    if (c->eol) return 0;
+
+    const char *start = skip_blanks(c->p, c->end);
+    const char *p = start;
+    int neg = 0;
+    if (p < c->end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    unsigned long long mant = 0;
+    int ndigits = 0, frac = 0;
+    while (p < c->end && (unsigned)(*p - '0') < 10) {
+        mant = mant * 10 + (unsigned)(*p++ - '0');
+        ndigits++;
+    }
+    if (p < c->end && *p == '.') {
+        p++;
+        while (p < c->end && (unsigned)(*p - '0') < 10) {
+            mant = mant * 10 + (unsigned)(*p++ - '0');
+            ndigits++;
+            frac++;
+        }
+    }
+
+    if (ndigits > 18 || (p < c->end && (*p == 'e' || *p == 'E'))) {
+        const char *sep = memchr(start, '|', (size_t)(c->end - start));
+        size_t len = (size_t)((sep ? sep : c->end) - start);
+        char tmp[64];
+        if (len >= sizeof(tmp)) len = sizeof(tmp) - 1;
+        memcpy(tmp, start, len);
+        tmp[len] = '\0';
+        char *endptr;
+        *out = strtof(tmp, &endptr);
+        c->p = start + (endptr - tmp);
+        return next_field(c) && endptr != tmp;
+    }
+
+    double v = (double)mant * pow10_neg[frac];
+    *out = (float)(neg ? -v : v);
+    c->p = p;
+    return next_field(c) && ndigits > 0;
+}
+
+// Leading integer of the field at p, read as strtol() does: optional blanks
+// and sign, then digits, saturating at LONG_MIN and LONG_MAX; 0 if none
+static long field_units(const char *p, const char *end)
+{
+    while (p < end && isspace((unsigned char)*p))
+        p++;
+    int neg = 0;
+    if (p < end && (*p == '+' || *p == '-'))
+        neg = *p++ == '-';
+
+    unsigned long v = 0, limit = neg ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        unsigned d = (unsigned)(*p++ - '0');
+        v = v > (limit - d) / 10 ? limit : v * 10 + d;
+    }
+    if (!neg) return (long)v;
+    return v ? -(long)(v - 1) - 1 : 0;
+}
+
+/* ============================================================
+   Call Type Decoding
+   ============================================================ */
+
+CallType cdr_call_type_n(const char *s, size_t len)
+{
+    switch (len) {
+    case 3:
+        if (strncasecmp(s, "MOC", 3) == 0) return CALL_MOC;
+        if (strncasecmp(s, "MTC", 3) == 0) return CALL_MTC;
+        break;
+    case 4:
+        if (strncasecmp(s, "GPRS", 4) == 0) return CALL_GPRS;
+        break;
+    case 6:
+        if (strncasecmp(s, "SMS-MO", 6) == 0) return CALL_SMS_MO;
+        if (strncasecmp(s, "SMS-MT", 6) == 0) return CALL_SMS_MT;
+        break;
+    }
+    return CALL_UNKNOWN;
+}
+
+CallType cdr_call_type(const char *s)
+{
+    return cdr_call_type_n(s, strlen(s));
+}
+
+// The call type names have no lower case letters
+static int call_type_exact(const char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (islower((unsigned char)s[i])) return 0;
+    }
+    return 1;
+}
+
+/* ============================================================
+   Record Decoder
+   ============================================================ */
+
+int cdr_decode(const char *line, const char *end, CdrRecord *rec)
+{
+    // Drop line terminators
+    while (end > line && (end[-1] == '\n' || end[-1] == '\r'))
+        end--;
+    if (end == line) return 0;
+
+    FieldCursor c = { line, end, 0 };
+    const char *callType;
+    int callTypeLen;
+    long opCode = 0, tpOpCode = 0;
+
+    memset(rec, 0, sizeof(*rec));
+
+    int ok = take_long(&c, &rec->msisdn);
+    ok &= take_string(&c, &rec->operatorName, &rec->operatorNameLen);
+    const char *opField = c.p;
+    ok &= take_long(&c, &opCode);
+    rec->operatorId = opField;
+    rec->operatorIdLen = c.eol ? (int)(c.p - opField) : (int)(c.p - opField - 1);
+    ok &= take_string(&c, &callType, &callTypeLen);
+    const char *durationField = c.p;
+    ok &= take_decimal(&c, &rec->duration);
+    const char *downloadField = c.p;
+    ok &= take_decimal(&c, &rec->download);
+    const char *uploadField = c.p;
+    ok &= take_decimal(&c, &rec->upload);
+    rec->durationUnits = field_units(durationField, downloadField);
+    rec->downloadUnits = field_units(downloadField, uploadField);
+    rec->uploadUnits = field_units(uploadField, c.p);
+    // Third party MSISDN is empty (||) on GPRS records
+    if (!c.eol && c.p < c.end && *c.p == '|')
+        c.p++;
+    else
+        ok &= take_long(&c, &rec->thirdPartyMsisdn);
+    ok &= take_long(&c, &tpOpCode);
+
+    rec->callType = cdr_call_type_n(callType, (size_t)callTypeLen);
+    rec->callTypeExact = call_type_exact(callType, (size_t)callTypeLen);
+    rec->operatorCode = (int)opCode;
+    rec->thirdPartyOpCode = (int)tpOpCode;
+    rec->complete = ok;
+    return 1;
+}
+
+int cdr_decode_line(char *line, CdrRecord *rec)
+{
+    return cdr_decode(line, line + strlen(line), rec);
+}
+
+/* ============================================================
+   File Ingest
+   ============================================================ */
+
+// Fallback for inputs that cannot be mapped (pipes, special files)
+static long ingest_stream(FILE *fp, CdrSink sink, void *ctx)
+{
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t n;
+    long records = 0;
+
+    while ((n = getline(&line, &len, fp)) != -1) {
+        CdrRecord rec;
+        if (!cdr_decode(line, line + n, &rec)) continue;
+        sink(&rec, ctx);
+        records++;
+    }
+
+    free(line);
+    return records;
+}
+
+long cdr_ingest_buffer(const char *data, size_t size, CdrSink sink, void *ctx)
+{
+    const char *p = data;
+    const char *end = data + size;
+    long records = 0;
+
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *lineEnd = nl ? nl : end;
+
+        CdrRecord rec;
+        if (cdr_decode(p, lineEnd, &rec)) {
+            sink(&rec, ctx);
+            records++;
+        }
+        p = nl ? nl + 1 : end;
+    }
+    return records;
+}
+
+size_t cdr_estimate_records(const char *filename)
+{
+    CdrCache cache;
+    if (cdr_cache_open(filename, &cache) == 0) {
+        size_t records = cache.records;
+        cdr_cache_close(&cache);
+        return records;
+    }
+
+    struct stat st;
+    if (stat(filename, &st) != 0 || st.st_size <= 0) return 0;
+    return (size_t)st.st_size / CDR_AVG_RECORD_BYTES;
+}
+
+// Map filename read-only. Returns 1 when mapped (size 0 for empty files, with
+// *map left NULL), 0 when the input must be streamed through *fp instead,
+// and -1 on error. *st receives the stat of what was mapped.
+static int open_cdr_input(const char *filename, void **map, size_t *size, FILE **fp,
+                          struct stat *st)
+{
+    *map = NULL;
+    *size = 0;
+    *fp = NULL;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening CDR file '%s': %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, st) == 0 && S_ISREG(st->st_mode)) {
+        if (st->st_size == 0) {
+            close(fd);
+            return 1;
+        }
+        void *m = mmap(NULL, (size_t)st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            close(fd);
+            *map = m;
+            *size = (size_t)st->st_size;
+            return 1;
+        }
+    }
+
+    *fp = fdopen(fd, "r");
+    if (!*fp) {
+        fprintf(stderr, "Error reading CDR file '%s': %s\n", filename, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+long cdr_ingest_file(const char *filename, CdrSink sink, void *ctx)
+{
+    void *map;
+    size_t size;
+    FILE *fp;
+    struct stat st;
+    long records;
+
+    CdrCache cache;
+    if (cdr_cache_open(filename, &cache) == 0) {
+        records = cdr_cache_ingest(&cache, 0, cache.records, sink, ctx);
+        cdr_cache_close(&cache);
+        return records;
+    }
+
+    int rc = open_cdr_input(filename, &map, &size, &fp, &st);
+    if (rc < 0) return -1;
+
+    if (rc == 0) {
+        records = ingest_stream(fp, sink, ctx);
+        fclose(fp);
+        return records;
+    }
+
+    if (!map) return 0;
+    madvise(map, size, MADV_SEQUENTIAL);
+    records = cdr_ingest_buffer(map, size, sink, ctx);
+    munmap(map, size);
+    return records;
+}
+
+/* ============================================================
+   Parallel Ingest
+   ============================================================ */
+
+// One newline-aligned byte range of the mapped file, or one record range of
+// the binary cache, and its private sink
+typedef struct {
+    const char *data;
+    size_t size;
+    const CdrCache *cache;
+    size_t begin;
+    size_t end;
+    CdrSink sink;
+    void *ctx;
+    CdrProgress *progress;      // shared, or NULL
+    CdrCacheWriter *writer;     // converts the range on the way, or NULL
+    long records;
+} IngestSlice;
+
+// Sink that also hands every record to the slice's cache writer
+typedef struct {
+    CdrSink sink;
+    void *ctx;
+    CdrCacheWriter *writer;
+} TeeSink;
+
+static void tee_sink(const CdrRecord *rec, void *ctx)
+{
+    TeeSink *tee = (TeeSink *)ctx;
+    cdr_cache_writer_add(tee->writer, rec);
+    tee->sink(rec, tee->ctx);
+}
+
+// Start of the first record at or after off
+static size_t align_to_record(const char *data, size_t size, size_t off)
+{
+    if (off == 0 || off >= size) return off < size ? off : size;
+    if (data[off - 1] == '\n') return off;
+    const char *nl = memchr(data + off, '\n', size - off);
+    return nl ? (size_t)(nl - data) + 1 : size;
+}
+
+static void add_progress(CdrProgress *progress, long records, size_t bytes)
+{
+    __atomic_fetch_add(&progress->records, records, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&progress->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+// Source bytes before cache record i, assuming records of even length
+static size_t source_share(const CdrCache *cache, size_t i)
+{
+    return (size_t)((double)cache->sourceSize * (double)i / (double)cache->records);
+}
+
+static void *ingest_slice_thread(void *arg)
+{
+    IngestSlice *slice = (IngestSlice *)arg;
+    TeeSink tee;
+    if (slice->writer) {
+        tee.sink = slice->sink;
+        tee.ctx = slice->ctx;
+        tee.writer = slice->writer;
+        slice->sink = tee_sink;
+        slice->ctx = &tee;
+    }
+
+    if (!slice->progress) {
+        if (slice->cache)
+            slice->records = cdr_cache_ingest(slice->cache, slice->begin, slice->end,
+                                              slice->sink, slice->ctx);
+        else
+            slice->records = cdr_ingest_buffer(slice->data, slice->size, slice->sink, slice->ctx);
+        return NULL;
+    }
+
+    // Same work in chunks, reporting after each
+    slice->records = 0;
+    if (slice->cache) {
+        const CdrCache *cache = slice->cache;
+        size_t step = CDR_PROGRESS_BYTES / CDR_AVG_RECORD_BYTES;
+        for (size_t i = slice->begin; i < slice->end; i += step) {
+            size_t stop = slice->end - i > step ? i + step : slice->end;
+            long n = cdr_cache_ingest(cache, i, stop, slice->sink, slice->ctx);
+            slice->records += n;
+            // Credit the source bytes these records came from, pro rata;
+            // the shares of all chunks add up to the whole source exactly
+            add_progress(slice->progress, n, source_share(cache, stop) - source_share(cache, i));
+        }
+    } else {
+        size_t off = 0;
+        while (off < slice->size) {
+            size_t stop = align_to_record(slice->data, slice->size, off + CDR_PROGRESS_BYTES);
+            long n = cdr_ingest_buffer(slice->data + off, stop - off, slice->sink, slice->ctx);
+            slice->records += n;
+            add_progress(slice->progress, n, stop - off);
+            off = stop;
+        }
+    }
+    return NULL;
+}
+
+// Run every slice, slice 0 on the calling thread, and sum their records
+static long run_slices(IngestSlice *slices, int nslices)
+{
+    pthread_t *threads = (pthread_t *)calloc((size_t)nslices, sizeof(pthread_t));
+    if (!threads) return -1;
+
+    int started = 1;
+    for (int i = 1; i < nslices; i++, started++) {
+        if (pthread_create(&threads[i], NULL, ingest_slice_thread, &slices[i]) != 0) {
+            fprintf(stderr, "Failed to start ingest thread %d, continuing inline\n", i);
+            break;
+        }
+    }
+    ingest_slice_thread(&slices[0]);
+    for (int i = started; i < nslices; i++)
+        ingest_slice_thread(&slices[i]);
+
+    long records = 0;
+    for (int i = 0; i < nslices; i++) {
+        if (i > 0 && i < started)
+            pthread_join(threads[i], NULL);
+        records += slices[i].records;
+    }
+
+    free(threads);
+    return records;
+}
+
+// Split the cache into contiguous record ranges, one per slice
+static long ingest_cache_parallel(const CdrCache *cache, int nthreads, CdrSink sink, void **ctxs,
+                                  CdrProgress *progress)
+{
+    size_t maxSlices = cache->records / (CDR_MIN_SLICE / CDR_AVG_RECORD_BYTES) + 1;
+    int nslices = (size_t)nthreads < maxSlices ? nthreads : (int)maxSlices;
+
+    IngestSlice *slices = (IngestSlice *)calloc((size_t)nslices, sizeof(IngestSlice));
+    if (!slices) return -1;
+
+    for (int i = 0; i < nslices; i++) {
+        slices[i].cache = cache;
+        slices[i].begin = cache->records / (size_t)nslices * (size_t)i;
+        slices[i].end = (i == nslices - 1) ? cache->records
+                      : cache->records / (size_t)nslices * (size_t)(i + 1);
+        slices[i].sink = sink;
+        slices[i].ctx = ctxs[i];
+        slices[i].progress = progress;
+    }
+
+    long records = run_slices(slices, nslices);
+    free(slices);
+    return records;
+}
+
+long cdr_ingest_file_parallel(const char *filename, int nthreads, CdrSink sink, void **ctxs)
+{
+    return cdr_ingest_file_range(filename, 0, SIZE_MAX, nthreads, sink, ctxs, NULL);
+}
+
+long cdr_ingest_file_range(const char *filename, size_t begin, size_t end,
+                           int nthreads, CdrSink sink, void **ctxs,
+                           CdrProgress *progress)
+{
+    void *map;
+    size_t size;
+    FILE *fp;
+    struct stat st;
+    long records = 0;
+
+    if (nthreads < 1) nthreads = 1;
+    if (begin >= end) return 0;
+
+    // The cache only stands in for the whole file
+    CdrCache cache;
+    if (begin == 0 && cdr_cache_open(filename, &cache) == 0) {
+        if (end >= cache.sourceSize) {
+            records = ingest_cache_parallel(&cache, nthreads, sink, ctxs, progress);
+            cdr_cache_close(&cache);
+            return records;
+        }
+        cdr_cache_close(&cache);
+    }
+
+    int rc = open_cdr_input(filename, &map, &size, &fp, &st);
+    if (rc < 0) return -1;
+
+    // Unmappable input: stream everything into the first partial
+    if (rc == 0) {
+        if (begin == 0 && end == SIZE_MAX) {
+            records = ingest_stream(fp, sink, ctxs[0]);
+            if (progress && records > 0) add_progress(progress, records, 0);
+        } else {
+            records = -1;
+        }
+        fclose(fp);
+        return records;
+    }
+    if (!map) return 0;
+
+    // Reading the whole text doubles as its conversion: each slice fills its
+    // own range of the cache columns, so no separate pass is needed
+    int convert = begin == 0 && end >= size && config_long(CFG_CDR_CACHE, 1);
+    if (end > size) end = size;
+    if (begin >= end) {
+        munmap(map, size);
+        return 0;
+    }
+    const char *data = (const char *)map + begin;
+    size_t len = end - begin;
+
+    // Small inputs are not worth a thread per core
+    size_t maxSlices = len / CDR_MIN_SLICE + 1;
+    int nslices = (size_t)nthreads < maxSlices ? nthreads : (int)maxSlices;
+
+    IngestSlice *slices = (IngestSlice *)calloc((size_t)nslices, sizeof(IngestSlice));
+    CdrCacheWriter **writers = convert ? (CdrCacheWriter **)calloc((size_t)nslices, sizeof(CdrCacheWriter *)) : NULL;
+    if (!slices) {
+        free(writers);
+        munmap(map, size);
+        return -1;
+    }
+
+    size_t start = 0;
+    for (int i = 0; i < nslices; i++) {
+        size_t stop = (i == nslices - 1) ? len
+                    : align_to_record(data, len, len / (size_t)nslices * (size_t)(i + 1));
+        if (stop < start) stop = start;
+        slices[i].data = data + start;
+        slices[i].size = stop - start;
+        slices[i].sink = sink;
+        slices[i].ctx = ctxs[i];
+        slices[i].progress = progress;
+        if (writers) {
+            writers[i] = cdr_cache_writer_new(slices[i].size / CDR_AVG_RECORD_BYTES);
+            slices[i].writer = writers[i];
+        }
+        start = stop;
+    }
+
+    records = run_slices(slices, nslices);
+
+    if (writers) {
+        int complete = records >= 0;
+        for (int i = 0; i < nslices; i++)
+            complete = complete && writers[i];
+        if (complete)
+            cdr_cache_write(filename, &st, writers, nslices);
+        for (int i = 0; i < nslices; i++)
+            cdr_cache_writer_free(writers[i]);
+        free(writers);
+    }
+
+    free(slices);
+    munmap(map, size);
+    return records;
+}
+
+int cdr_file_extent(const char *filename, size_t *size, size_t *complete)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+
+    // Scan backwards for the last newline
+    char buf[4096];
+    size_t pos = (size_t)st.st_size;
+    int rc = 0;
+    *size = pos;
+    *complete = 0;
+    while (pos > 0 && *complete == 0) {
+        size_t n = pos < sizeof(buf) ? pos : sizeof(buf);
+        if (pread(fd, buf, n, (off_t)(pos - n)) != (ssize_t)n) {
+            rc = -1;
+            break;
+        }
+        pos -= n;
+        for (size_t i = n; i > 0; i--) {
+            if (buf[i - 1] == '\n') {
+                *complete = pos + i;
+                break;
+            }
+        }
+    }
+    close(fd);
+    return rc;
+}
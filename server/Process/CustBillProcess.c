@@ -1,95 +1,190 @@
 // CustBillProcess.c - Customer billing CDR processing
+// All aggregation state lives in the CustomerTable passed in by the caller,
+// so independent billing jobs can run concurrently.
 #include "../Header/CustBillProcess.h"
+#include "../Header/BillingJob.h"
+#include "../Header/outfile.h"
 
 /* ============================================================
-   Static Variables
+   Hash Function
    ============================================================ */
 
-static Customer *hashTable[HASH_SIZE];
-static int totalRecords = 0;
+// 64-bit finalizer (splitmix64); MSISDNs are dense and sequential, so the
+// low bits must be well mixed before masking to a power-of-two capacity
+uint64_t hashFunction(long key)
+{
+    uint64_t h = (uint64_t)key;
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
 
 /* ============================================================
-   Hash Function
+   Customer Storage
    ============================================================ */
 
-unsigned int hashFunction(long key)
+#define CUST_CHUNK_SIZE ((size_t)1 << CUST_CHUNK_SHIFT)
+#define CUST_CHUNK_MASK (CUST_CHUNK_SIZE - 1)
+
+Customer* customerAt(const CustomerTable *table, size_t index)
 {
-    return (unsigned int)(key % HASH_SIZE);
+    return &table->chunks[index >> CUST_CHUNK_SHIFT][index & CUST_CHUNK_MASK];
 }
 
-/* ============================================================
-   Customer Management Functions
-   ============================================================ */
+// Allocate storage chunk number chunk from the arena
+static int allocCustomerChunk(CustomerTable *table, size_t chunk)
+{
+    if (chunk >= table->nchunks) {
+        size_t n = table->nchunks ? table->nchunks * 2 : 16;
+        while (n <= chunk)
+            n *= 2;
+        Customer **chunks = (Customer **)realloc(table->chunks, n * sizeof(Customer *));
+        if (!chunks) return -1;
+        table->chunks = chunks;
+        table->nchunks = n;
+    }
+    table->chunks[chunk] = (Customer *)arena_alloc(&table->arena,
+                                                   CUST_CHUNK_SIZE * sizeof(Customer));
+    return table->chunks[chunk] ? 0 : -1;
+}
 
-Customer* createCustomer(long msisdn, const char *operatorName, int operatorCode)
+// Append a zeroed customer to dense storage; chunks come from the arena
+Customer* createCustomer(CustomerTable *table, long msisdn, int opIndex)
 {
-    Customer *cust = (Customer *)malloc(sizeof(Customer));
-    if (!cust) return NULL;
-    
-    // Initialize customer data
+    size_t index = table->count;
+    if ((index & CUST_CHUNK_MASK) == 0 &&
+        allocCustomerChunk(table, index >> CUST_CHUNK_SHIFT) != 0)
+        return NULL;
+
+    Customer *cust = customerAt(table, index);
+    memset(cust, 0, sizeof(*cust));
     cust->msisdn = msisdn;
-    strncpy(cust->operatorName, operatorName, sizeof(cust->operatorName) - 1);
-    cust->operatorName[sizeof(cust->operatorName) - 1] = '\0';
-    cust->operatorCode = operatorCode;
-    
-    // Initialize all counters to zero
-    cust->inVoiceWithin = cust->outVoiceWithin = 0;
-    cust->inVoiceOutside = cust->outVoiceOutside = 0;
-    cust->smsInWithin = cust->smsOutWithin = 0;
-    cust->smsInOutside = cust->smsOutOutside = 0;
-    cust->mbDownload = cust->mbUpload = 0;
-    cust->next = NULL;
-    
+    cust->opIndex = (uint16_t)opIndex;
     return cust;
 }
 
-Customer* getCustomer(long msisdn, const char *operatorName, int operatorCode)
+/* ============================================================
+   Open Addressing Table
+   ============================================================ */
+
+// Slot index for msisdn: the slot holding it, or the empty slot where it
+// belongs (linear probing; the table is never full)
+static size_t findSlot(const CustomerTable *table, long msisdn, uint64_t hash)
 {
-    unsigned int index = hashFunction(msisdn);
-    Customer *curr = hashTable[index];
-    
-    // Search for existing customer in chain
-    while (curr) {
-        if (curr->msisdn == msisdn)
-            return curr;
-        curr = curr->next;
+    size_t mask = table->capacity - 1;
+    size_t i = (size_t)hash & mask;
+    uint32_t tag = (uint32_t)(hash >> 32);
+    while (table->slots[i].index) {
+        if (table->slots[i].tag == tag &&
+            customerAt(table, table->slots[i].index - 1)->msisdn == msisdn)
+            break;
+        i = (i + 1) & mask;
     }
+    return i;
+}
+
+static int resizeCustomerTable(CustomerTable *table, size_t capacity)
+{
+    CustomerSlot *slots = (CustomerSlot *)calloc(capacity, sizeof(CustomerSlot));
+    if (!slots) return -1;
+
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+
+    // Rehash from dense storage; every key is known to be distinct
+    size_t mask = capacity - 1;
+    for (size_t n = 0; n < table->count; n++) {
+        uint64_t hash = hashFunction(customerAt(table, n)->msisdn);
+        size_t i = (size_t)hash & mask;
+        while (slots[i].index)
+            i = (i + 1) & mask;
+        slots[i].tag = (uint32_t)(hash >> 32);
+        slots[i].index = (uint32_t)(n + 1);
+    }
+    return 0;
+}
+
+int reserveCustomerTable(CustomerTable *table, size_t expected)
+{
+    // Keep the load factor at or below CUST_MAX_LOAD_PCT
+    size_t needed = expected * 100 / CUST_MAX_LOAD_PCT + 1;
+    size_t capacity = table->capacity ? table->capacity : CUST_MIN_CAPACITY;
+    while (capacity < needed)
+        capacity <<= 1;
+
+    if (capacity == table->capacity) return 0;
+    return resizeCustomerTable(table, capacity);
+}
+
+Customer* getCustomer(CustomerTable *table, long msisdn, int opIndex)
+{
+    if (table->capacity == 0 && reserveCustomerTable(table, 0) != 0)
+        return NULL;
+
+    uint64_t hash = hashFunction(msisdn);
+    size_t slot = findSlot(table, msisdn, hash);
+    if (table->slots[slot].index)
+        return customerAt(table, table->slots[slot].index - 1);
     
-    // Customer not found - create new one and add to hash table
-    Customer *newCust = createCustomer(msisdn, operatorName, operatorCode);
+    // Customer not found - grow first if the new entry would overload the table
+    if ((table->count + 1) * 100 > table->capacity * CUST_MAX_LOAD_PCT) {
+        if (resizeCustomerTable(table, table->capacity << 1) != 0)
+            return NULL;
+        slot = findSlot(table, msisdn, hash);
+    }
+
+    Customer *newCust = createCustomer(table, msisdn, opIndex);
     if (newCust) {
-        newCust->next = hashTable[index];
-        hashTable[index] = newCust;
+        table->slots[slot].tag = (uint32_t)(hash >> 32);
+        table->slots[slot].index = (uint32_t)(++table->count);
     }
     
     return newCust;
 }
 
+// Read-only lookup, NULL if msisdn was never seen
+Customer* findCustomer(const CustomerTable *table, long msisdn)
+{
+    if (table->capacity == 0) return NULL;
+
+    size_t slot = findSlot(table, msisdn, hashFunction(msisdn));
+    if (!table->slots[slot].index) return NULL;
+    return customerAt(table, table->slots[slot].index - 1);
+}
+
 /* ============================================================
    Helper Functions (Internal)
    ============================================================ */
 
-static void updateCustomerStats(Customer *cust, const char *callType, 
+static void updateCustomerStats(Customer *cust, CallType callType, 
                                 int sameOperator, float duration, 
                                 float download, float upload)
 {
-    if (strcmp(callType, "MOC") == 0) {
+    switch (callType) {
+    case CALL_MOC:
         sameOperator ? (cust->outVoiceWithin += duration) 
                     : (cust->outVoiceOutside += duration);
-    }
-    else if (strcmp(callType, "MTC") == 0) {
+        break;
+    case CALL_MTC:
         sameOperator ? (cust->inVoiceWithin += duration) 
                     : (cust->inVoiceOutside += duration);
-    }
-    else if (strcmp(callType, "SMS-MO") == 0) {
+        break;
+    case CALL_SMS_MO:
         sameOperator ? cust->smsOutWithin++ : cust->smsOutOutside++;
-    }
-    else if (strcmp(callType, "SMS-MT") == 0) {
+        break;
+    case CALL_SMS_MT:
         sameOperator ? cust->smsInWithin++ : cust->smsInOutside++;
-    }
-    else if (strcmp(callType, "GPRS") == 0) {
+        break;
+    case CALL_GPRS:
         cust->mbDownload += download;
         cust->mbUpload += upload;
+        break;
+    default:
+        break;
     }
 }
 
@@ -97,147 +192,493 @@ static void updateCustomerStats(Customer *cust, const char *callType,
    CDR File Processing
    ============================================================ */
 
-void processCDRFile(const char *filename)
+void addCustomerRecord(CustomerTable *table, const CdrRecord *rec, int opIndex)
 {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        fprintf(stderr, "Error opening CDR file '%s': %s\n", filename, strerror(errno));
-        return;
-    }
+    if (!rec->complete || opIndex < 0) return; // Skip invalid lines
     
-    char line[512];
-    totalRecords = 0;
+    // Get or create customer record
+    Customer *cust = getCustomer(table, rec->msisdn, opIndex);
+    if (!cust) return;
     
-    while (fgets(line, sizeof(line), fp)) {
-        // Remove newline characters
-        line[strcspn(line, "\r\n")] = 0;
-        
-        // Initialize CDR fields
-        long msisdn = 0, thirdPartyMsisdn = 0;
-        char opName[64] = {0}, callType[16] = {0};
-        int opCode = 0, thirdPartyOpCode = 0;
-        float duration = 0, download = 0, upload = 0;
-        
-        // Parse CDR line (9 fields expected)
-        int matched = sscanf(line, "%ld|%63[^|]|%d|%15[^|]|%f|%f|%f|%ld|%d",
-                            &msisdn, opName, &opCode, callType,
-                            &duration, &download, &upload,
-                            &thirdPartyMsisdn, &thirdPartyOpCode);
-        
-        // Handle edge case: GPRS records with empty third party MSISDN (||)
-        if (matched < 9) {
-            matched = sscanf(line, "%ld|%63[^|]|%d|%15[^|]|%f|%f|%f||%d",
-                            &msisdn, opName, &opCode, callType,
-                            &duration, &download, &upload, &thirdPartyOpCode);
-            if (matched < 8) continue; // Skip invalid lines
-        }
-        
-        // Get or create customer record
-        Customer *cust = getCustomer(msisdn, opName, opCode);
+    // Determine if call is within same operator
+    int sameOperator = (rec->operatorCode == rec->thirdPartyOpCode);
+    
+    // Update customer statistics; call types only count in upper case
+    CallType callType = rec->callTypeExact ? rec->callType : CALL_UNKNOWN;
+    updateCustomerStats(cust, callType, sameOperator,
+                        rec->duration, rec->download, rec->upload);
+    
+    table->totalRecords++;
+}
+
+typedef struct {
+    CustomerTable *customers;
+    OpTable *operators;
+} CustomerSinkCtx;
+
+static void customerSink(const CdrRecord *rec, void *ctx)
+{
+    CustomerSinkCtx *sink = (CustomerSinkCtx *)ctx;
+    if (!rec->complete) return;
+    int opIndex = intern_operator(sink->operators, rec->operatorId, (size_t)rec->operatorIdLen,
+                                  rec->operatorName, (size_t)rec->operatorNameLen);
+    addCustomerRecord(sink->customers, rec, opIndex);
+}
+
+void processCDRFile(CustomerTable *table, OpTable *operators, const char *filename)
+{
+    CustomerSinkCtx sink = { table, operators };
+    reserveCustomerTable(table, table->count +
+                         cdr_estimate_records(filename) / CUST_RECORDS_PER_CUSTOMER);
+    cdr_ingest_file(filename, customerSink, &sink);
+}
+
+/* ============================================================
+   Partial Table Merge
+   ============================================================ */
+
+// Fold a worker's partial table into dst, rewriting operator indexes through
+// opRemap (see merge_op_table). Customers new to dst are appended in the
+// partial's first-seen order; an existing customer keeps the operator it
+// was first seen with. The partial table is left empty.
+void mergeCustomerTable(CustomerTable *dst, CustomerTable *partial, const int *opRemap)
+{
+    if (partial->count > 0 &&
+        reserveCustomerTable(dst, dst->count + partial->count) != 0) {
+        fprintf(stderr, "Error merging customer table: out of memory\n");
+        freeCustomerTable(partial);
+        return;
+    }
+
+    for (size_t n = 0; n < partial->count; n++) {
+        const Customer *src = customerAt(partial, n);
+        Customer *cust = getCustomer(dst, src->msisdn, opRemap[src->opIndex]);
         if (!cust) continue;
-        
-        // Determine if call is within same operator
-        int sameOperator = (opCode == thirdPartyOpCode);
-        
-        // Update customer statistics
-        updateCustomerStats(cust, callType, sameOperator, duration, download, upload);
-        
-        totalRecords++;
+
+        cust->inVoiceWithin += src->inVoiceWithin;
+        cust->outVoiceWithin += src->outVoiceWithin;
+        cust->inVoiceOutside += src->inVoiceOutside;
+        cust->outVoiceOutside += src->outVoiceOutside;
+        cust->mbDownload += src->mbDownload;
+        cust->mbUpload += src->mbUpload;
+        cust->smsInWithin += src->smsInWithin;
+        cust->smsOutWithin += src->smsOutWithin;
+        cust->smsInOutside += src->smsInOutside;
+        cust->smsOutOutside += src->smsOutOutside;
     }
-    
-    fclose(fp);
+    dst->totalRecords += partial->totalRecords;
+    freeCustomerTable(partial);
+}
+
+/* ============================================================
+   Parallel Sharded Merge
+   ============================================================ */
+
+// Where a merged customer was first seen: part 0 is dst itself, part i + 1
+// is partial i
+typedef struct {
+    uint32_t part;
+    uint32_t index;
+} MergeOrigin;
+
+// One hash range of the customers, aggregated by one thread
+typedef struct {
+    CustomerTable table;
+    MergeOrigin *origins;       // per customer of table
+    size_t originCapacity;
+    int failed;
+} MergeShard;
+
+typedef struct {
+    CustomerTable **parts;      // dst, then the partials
+    int nparts;
+    int *const *opRemaps;
+    int nshards;
+    uint32_t **order;           // per part: customer indexes grouped by shard
+    size_t **bounds;            // per part: nshards + 1 group boundaries
+    uint32_t **ranks;           // per part: first-seen flags, then their ranks
+    size_t *bases;              // per part: final index of its first new customer
+    size_t *fresh;              // per part: customers first seen there
+    MergeShard *shards;
+} MergeCtx;
+
+typedef struct {
+    MergeCtx *ctx;
+    int id;
+} MergeTask;
+
+static int shardOf(long msisdn, int nshards)
+{
+    return (int)(((hashFunction(msisdn) >> 32) * (uint64_t)nshards) >> 32);
+}
+
+// Group one part's customer indexes by shard (counting sort)
+static void *mergeBucketPart(void *arg)
+{
+    MergeTask *task = (MergeTask *)arg;
+    MergeCtx *ctx = task->ctx;
+    const CustomerTable *part = ctx->parts[task->id];
+    size_t *bounds = ctx->bounds[task->id];
+    uint32_t *order = ctx->order[task->id];
+
+    for (size_t n = 0; n < part->count; n++)
+        bounds[shardOf(customerAt(part, n)->msisdn, ctx->nshards) + 1]++;
+    for (int s = 0; s < ctx->nshards; s++)
+        bounds[s + 1] += bounds[s];
+
+    size_t *next = (size_t *)malloc((size_t)ctx->nshards * sizeof(size_t));
+    if (!next) {
+        ctx->shards[0].failed = 1;
+        return NULL;
+    }
+    memcpy(next, bounds, (size_t)ctx->nshards * sizeof(size_t));
+    for (size_t n = 0; n < part->count; n++)
+        order[next[shardOf(customerAt(part, n)->msisdn, ctx->nshards)]++] = (uint32_t)n;
+    free(next);
+    return NULL;
 }
 
-static void writeCustomerRecord(FILE *fp, Customer *cust)
+// Aggregate one shard across every part, in part order, flagging customers
+// at the place they are first seen
+static void *mergeAggregateShard(void *arg)
 {
-    fprintf(fp, "\nCustomer ID: %ld (%s)\n", cust->msisdn, cust->operatorName);
-    fprintf(fp, "* Services within the mobile operator *\n");
-    fprintf(fp, "Incoming voice call durations: %.2f\n", cust->inVoiceWithin);
-    fprintf(fp, "Outgoing voice call durations: %.2f\n", cust->outVoiceWithin);
-    fprintf(fp, "Incoming SMS messages: %d\n", cust->smsInWithin);
-    fprintf(fp, "Outgoing SMS messages: %d\n", cust->smsOutWithin);
-    fprintf(fp, "* Services outside the mobile operator *\n");
-    fprintf(fp, "Incoming voice call durations: %.2f\n", cust->inVoiceOutside);
-    fprintf(fp, "Outgoing voice call durations: %.2f\n", cust->outVoiceOutside);
-    fprintf(fp, "Incoming SMS messages: %d\n", cust->smsInOutside);
-    fprintf(fp, "Outgoing SMS messages: %d\n", cust->smsOutOutside);
-    fprintf(fp, "* Internet use *\n");
-    fprintf(fp, "MB downloaded: %.2f | MB uploaded: %.2f\n",
-            cust->mbDownload, cust->mbUpload);
-    fprintf(fp, "----------------------------------------\n");
+    MergeTask *task = (MergeTask *)arg;
+    MergeCtx *ctx = task->ctx;
+    MergeShard *shard = &ctx->shards[task->id];
+    CustomerTable *table = &shard->table;
+
+    for (int q = 0; q < ctx->nparts && !shard->failed; q++) {
+        const CustomerTable *part = ctx->parts[q];
+        const int *remap = q > 0 ? ctx->opRemaps[q - 1] : NULL;
+        for (size_t k = ctx->bounds[q][task->id]; k < ctx->bounds[q][task->id + 1]; k++) {
+            uint32_t n = ctx->order[q][k];
+            const Customer *src = customerAt(part, n);
+            size_t before = table->count;
+            Customer *cust = getCustomer(table, src->msisdn,
+                                         remap ? remap[src->opIndex] : src->opIndex);
+            if (!cust) {
+                shard->failed = 1;
+                break;
+            }
+            if (table->count > before) {
+                if (before == shard->originCapacity) {
+                    size_t grown = before ? before * 2 : 1024;
+                    MergeOrigin *more = (MergeOrigin *)realloc(shard->origins,
+                                                               grown * sizeof(MergeOrigin));
+                    if (!more) {
+                        shard->failed = 1;
+                        break;
+                    }
+                    shard->origins = more;
+                    shard->originCapacity = grown;
+                }
+                shard->origins[before].part = (uint32_t)q;
+                shard->origins[before].index = n;
+                ctx->ranks[q][n] = 1;
+            }
+
+            cust->inVoiceWithin += src->inVoiceWithin;
+            cust->outVoiceWithin += src->outVoiceWithin;
+            cust->inVoiceOutside += src->inVoiceOutside;
+            cust->outVoiceOutside += src->outVoiceOutside;
+            cust->mbDownload += src->mbDownload;
+            cust->mbUpload += src->mbUpload;
+            cust->smsInWithin += src->smsInWithin;
+            cust->smsOutWithin += src->smsOutWithin;
+            cust->smsInOutside += src->smsInOutside;
+            cust->smsOutOutside += src->smsOutOutside;
+        }
+    }
+    return NULL;
+}
+
+// Turn one part's first-seen flags into ranks among its new customers
+static void *mergeRankPart(void *arg)
+{
+    MergeTask *task = (MergeTask *)arg;
+    MergeCtx *ctx = task->ctx;
+    uint32_t *ranks = ctx->ranks[task->id];
+    size_t count = ctx->parts[task->id]->count, fresh = 0;
+    for (size_t n = 0; n < count; n++) {
+        uint32_t seen = ranks[n];
+        ranks[n] = (uint32_t)fresh;
+        fresh += seen;
+    }
+    ctx->fresh[task->id] = fresh;
+    return NULL;
+}
+
+// Store one shard's customers at their final positions in dst
+static void *mergePlaceShard(void *arg)
+{
+    MergeTask *task = (MergeTask *)arg;
+    MergeCtx *ctx = task->ctx;
+    MergeShard *shard = &ctx->shards[task->id];
+    CustomerTable *dst = ctx->parts[0];
+
+    for (size_t k = 0; k < shard->table.count; k++) {
+        MergeOrigin o = shard->origins[k];
+        size_t index = o.part == 0 ? o.index : ctx->bases[o.part] + ctx->ranks[o.part][o.index];
+        *customerAt(dst, index) = *customerAt(&shard->table, k);
+    }
+    freeCustomerTable(&shard->table);
+    return NULL;
+}
+
+// Run fn over tasks [0, n), task 0 on the calling thread
+static void runMergePhase(void *(*fn)(void *), MergeTask *tasks, int n)
+{
+    pthread_t *threads = (pthread_t *)calloc((size_t)n, sizeof(pthread_t));
+    int started = 1;
+    for (int i = 1; threads && i < n; i++, started++) {
+        if (pthread_create(&threads[i], NULL, fn, &tasks[i]) != 0) break;
+    }
+    fn(&tasks[0]);
+    for (int i = started; i < n; i++)
+        fn(&tasks[i]);
+    for (int i = 1; i < started; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+}
+
+// Shard-parallel merge; returns -1 with dst and the partials untouched when
+// memory runs out before customers are placed
+static int mergeSharded(CustomerTable *dst, CustomerTable **partials, int *const *opRemaps,
+                        int count, int nthreads)
+{
+    MergeCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.nparts = count + 1;
+    ctx.nshards = nthreads;
+    ctx.opRemaps = opRemaps;
+    int ntasks = ctx.nparts > ctx.nshards ? ctx.nparts : ctx.nshards;
+
+    ctx.parts = (CustomerTable **)calloc((size_t)ctx.nparts, sizeof(CustomerTable *));
+    ctx.order = (uint32_t **)calloc((size_t)ctx.nparts, sizeof(uint32_t *));
+    ctx.bounds = (size_t **)calloc((size_t)ctx.nparts, sizeof(size_t *));
+    ctx.ranks = (uint32_t **)calloc((size_t)ctx.nparts, sizeof(uint32_t *));
+    ctx.bases = (size_t *)calloc((size_t)ctx.nparts, sizeof(size_t));
+    ctx.fresh = (size_t *)calloc((size_t)ctx.nparts, sizeof(size_t));
+    ctx.shards = (MergeShard *)calloc((size_t)ctx.nshards, sizeof(MergeShard));
+    MergeTask *tasks = (MergeTask *)calloc((size_t)ntasks, sizeof(MergeTask));
+    int ok = ctx.parts && ctx.order && ctx.bounds && ctx.ranks && ctx.bases &&
+             ctx.fresh && ctx.shards && tasks;
+
+    size_t largest = 0;
+    for (int q = 0; ok && q < ctx.nparts; q++) {
+        CustomerTable *part = q == 0 ? dst : partials[q - 1];
+        ctx.parts[q] = part;
+        ctx.order[q] = (uint32_t *)malloc((part->count + 1) * sizeof(uint32_t));
+        ctx.bounds[q] = (size_t *)calloc((size_t)ctx.nshards + 1, sizeof(size_t));
+        ctx.ranks[q] = (uint32_t *)calloc(part->count + 1, sizeof(uint32_t));
+        ok = ctx.order[q] && ctx.bounds[q] && ctx.ranks[q];
+        if (part->count > largest) largest = part->count;
+    }
+    for (int i = 0; ok && i < ntasks; i++) {
+        tasks[i].ctx = &ctx;
+        tasks[i].id = i;
+    }
+    for (int s = 0; ok && s < ctx.nshards; s++)
+        ok = reserveCustomerTable(&ctx.shards[s].table, largest / (size_t)ctx.nshards) == 0;
+
+    if (ok) runMergePhase(mergeBucketPart, tasks, ctx.nparts);
+    if (ok && !ctx.shards[0].failed) runMergePhase(mergeAggregateShard, tasks, ctx.nshards);
+    for (int s = 0; ok && s < ctx.nshards; s++)
+        ok = !ctx.shards[s].failed;
+    if (ok) runMergePhase(mergeRankPart, tasks, ctx.nparts);
+
+    // New customers follow dst's own, part by part in first-seen order
+    size_t total = dst->count;
+    for (int q = 1; ok && q < ctx.nparts; q++) {
+        ctx.bases[q] = total;
+        total += ctx.fresh[q];
+    }
+    size_t firstChunk = (dst->count + CUST_CHUNK_MASK) >> CUST_CHUNK_SHIFT;
+    for (size_t c = firstChunk; ok && (c << CUST_CHUNK_SHIFT) < total; c++)
+        ok = allocCustomerChunk(dst, c) == 0;
+    size_t capacity = dst->capacity ? dst->capacity : CUST_MIN_CAPACITY;
+    while (capacity < total * 100 / CUST_MAX_LOAD_PCT + 1)
+        capacity <<= 1;
+
+    if (ok) {
+        runMergePhase(mergePlaceShard, tasks, ctx.nshards);
+        dst->count = total;
+        for (int i = 0; i < count; i++) {
+            dst->totalRecords += partials[i]->totalRecords;
+            freeCustomerTable(partials[i]);
+        }
+        // Index the placed customers
+        if (resizeCustomerTable(dst, capacity) != 0)
+            fprintf(stderr, "Error merging customer table: out of memory\n");
+    }
+
+    for (int s = 0; ctx.shards && s < ctx.nshards; s++) {
+        freeCustomerTable(&ctx.shards[s].table);
+        free(ctx.shards[s].origins);
+    }
+    for (int q = 0; q < ctx.nparts; q++) {
+        if (ctx.order) free(ctx.order[q]);
+        if (ctx.bounds) free(ctx.bounds[q]);
+        if (ctx.ranks) free(ctx.ranks[q]);
+    }
+    free(ctx.parts);
+    free(ctx.order);
+    free(ctx.bounds);
+    free(ctx.ranks);
+    free(ctx.bases);
+    free(ctx.fresh);
+    free(ctx.shards);
+    free(tasks);
+    return ok ? 0 : -1;
+}
+
+void mergeCustomerTables(CustomerTable *dst, CustomerTable **partials, int *const *opRemaps,
+                         int count, int nthreads)
+{
+    if (nthreads > 1 && count > 1 &&
+        mergeSharded(dst, partials, opRemaps, count, nthreads) == 0)
+        return;
+    for (int i = 0; i < count; i++)
+        mergeCustomerTable(dst, partials[i], opRemaps[i]);
+}
+
+// One CB.txt customer block, from the "Customer ID" line to the separator
+int formatCustomerRecord(char *buf, size_t len, const Customer *cust, const char *operatorName)
+{
+    return snprintf(buf, len,
+                    "Customer ID: %ld (%s)\n"
+                    "* Services within the mobile operator *\n"
+                    "Incoming voice call durations: %.2f\n"
+                    "Outgoing voice call durations: %.2f\n"
+                    "Incoming SMS messages: %d\n"
+                    "Outgoing SMS messages: %d\n"
+                    "* Services outside the mobile operator *\n"
+                    "Incoming voice call durations: %.2f\n"
+                    "Outgoing voice call durations: %.2f\n"
+                    "Incoming SMS messages: %d\n"
+                    "Outgoing SMS messages: %d\n"
+                    "* Internet use *\n"
+                    "MB downloaded: %.2f | MB uploaded: %.2f\n"
+                    "----------------------------------------\n",
+                    cust->msisdn, operatorName,
+                    cust->inVoiceWithin, cust->outVoiceWithin,
+                    cust->smsInWithin, cust->smsOutWithin,
+                    cust->inVoiceOutside, cust->outVoiceOutside,
+                    cust->smsInOutside, cust->smsOutOutside,
+                    cust->mbDownload, cust->mbUpload);
+}
+
+// Returns the number of bytes written, leading blank line included
+static size_t writeCustomerRecord(FILE *fp, const Customer *cust, const char *operatorName)
+{
+    char block[CUST_RECORD_MAX];
+    int len = formatCustomerRecord(block, sizeof(block), cust, operatorName);
+    if (len >= (int)sizeof(block)) len = (int)sizeof(block) - 1;
+    fputc('\n', fp);
+    fwrite(block, 1, (size_t)len, fp);
+    return (size_t)len + 1;
 }
 
 /* ============================================================
    Output Generation
    ============================================================ */
 
-void writeCBFile(const char *outputFile)
+static int compareIndexEntry(const void *a, const void *b)
 {
-    FILE *fp = fopen(outputFile, "w");
-    if (!fp) {
-        fprintf(stderr, "Error creating output file '%s': %s\n", outputFile, strerror(errno));
+    int64_t x = ((const CBIndexEntry *)a)->msisdn;
+    int64_t y = ((const CBIndexEntry *)b)->msisdn;
+    return (x > y) - (x < y);
+}
+
+// Write <report>.idx: record offsets sorted by MSISDN, stamped with the
+// identity of the committed report so a replaced CB.txt invalidates it
+static void writeCBIndex(const char *reportFile, CBIndexEntry *entries, size_t count)
+{
+    struct stat st;
+    char path[512];
+    if (stat(reportFile, &st) != 0 ||
+        snprintf(path, sizeof(path), "%s%s", reportFile, CB_INDEX_SUFFIX) >= (int)sizeof(path))
+        return;
+
+    qsort(entries, count, sizeof(CBIndexEntry), compareIndexEntry);
+
+    CBIndexHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CB_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = CB_INDEX_VERSION;
+    hdr.reportSize = (uint64_t)st.st_size;
+    hdr.reportMtimeSec = (int64_t)st.st_mtim.tv_sec;
+    hdr.reportMtimeNsec = (int64_t)st.st_mtim.tv_nsec;
+    hdr.reportIno = (uint64_t)st.st_ino;
+    hdr.count = count;
+
+    OutFile out;
+    FILE *fp = outfile_open(&out, path);
+    if (!fp) return;
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(entries, sizeof(CBIndexEntry), count, fp) != count) {
+        outfile_abort(&out);
         return;
     }
+    outfile_commit(&out);
+}
+
+int writeCBFile(const CustomerTable *table, const OpTable *operators, const char *outputFile)
+{
+    OutFile out;
+    FILE *fp = outfile_open(&out, outputFile);
+    if (!fp) return -1;
+    
+    // Offsets of every "Customer ID" line, for the sidecar index
+    CBIndexEntry *index = (CBIndexEntry *)malloc((table->count + 1) * sizeof(CBIndexEntry));
     
-    fprintf(fp, "#Customers Data Base:\n");
+    const char *title = "#Customers Data Base:\n";
+    fputs(title, fp);
+    uint64_t offset = strlen(title);
     
-    // Iterate through hash table and write all customer records
-    int customerCount = 0;
-    for (int i = 0; i < HASH_SIZE; i++) {
-        Customer *cust = hashTable[i];
-        while (cust) {
-            writeCustomerRecord(fp, cust);
-            customerCount++;
-            cust = cust->next;
+    // Write all customer records in first-seen order
+    for (size_t n = 0; n < table->count; n++) {
+        const Customer *cust = customerAt(table, n);
+        if (index) {
+            index[n].msisdn = cust->msisdn;
+            index[n].offset = offset + 1;
         }
+        offset += writeCustomerRecord(fp, cust, operator_name_at(operators, cust->opIndex));
     }
     
-    fclose(fp);
+    // The index only speeds up searches, so failing to write it is not an error
+    int rc = outfile_commit(&out);
+    if (rc == 0 && index)
+        writeCBIndex(outputFile, index, table->count);
+    free(index);
+    return rc;
 }
 
 /* ============================================================
    Memory Management
    ============================================================ */
 
-void cleanupHashTable(void)
+// Customers are released with the arena in one go, no per-record free
+void freeCustomerTable(CustomerTable *table)
 {
-    for (int i = 0; i < HASH_SIZE; i++) {
-        Customer *cust = hashTable[i];
-        while (cust) {
-            Customer *temp = cust;
-            cust = cust->next;
-            free(temp);
-        }
-        hashTable[i] = NULL;
-    }
+    arena_release(&table->arena);
+    free(table->slots);
+    free(table->chunks);
+    memset(table, 0, sizeof(*table));
 }
 
 /* ============================================================
-   Thread Entry Point
+   Report Thread Entry Point
    ============================================================ */
 
-void* custbillprocess(void *arg)
+int custbillreport(void *arg)
 {
-    ProcessThreadArg *threadArg = (ProcessThreadArg *)arg;
+    BillingJob *job = (BillingJob *)arg;
     
-    // Build file paths
-    const char *inputPath = "data/data.cdr";
+    // Build output path
     char outputPath[300];
-    snprintf(outputPath, sizeof(outputPath), "%s/CB.txt", 
-             threadArg ? threadArg->output_dir : "Output");
-    
-    // Initialize hash table to NULL
-    for (int i = 0; i < HASH_SIZE; i++)
-        hashTable[i] = NULL;
+    snprintf(outputPath, sizeof(outputPath), "%s/CB.txt", job->output_dir);
     
-    // Process CDR file and aggregate customer data
-    processCDRFile(inputPath);
-    
-    // Write customer billing report
-    writeCBFile(outputPath);
-    
-    // Free allocated memory
-    cleanupHashTable();
-    
-    return NULL;
+    // Write customer billing report from the job's aggregated records
+    return writeCBFile(&job->customers, &job->operators, outputPath);
 }
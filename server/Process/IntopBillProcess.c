@@ -1,46 +1,113 @@
 // IntopBillProcess.c - Interoperator billing CDR processing
+// All aggregation state lives in the OpTable passed in by the caller,
+// so independent billing jobs can run concurrently.
 #include "../Header/IntopBillProcess.h"
-#include "../Header/CustBillProcess.h" // for ProcessThreadArg
+#include "../Header/BillingJob.h"
+#include "../Header/outfile.h"
 
 /* ============================================================
-   Static Variables
+   Operator Table Implementation
    ============================================================ */
 
-static OpNode *buckets[NUM_BUCKETS] = {NULL};
+// FNV-1a over the operator id text
+static unsigned op_hash(const char *id, size_t len)
+{
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)id[i]) * 16777619u;
+    return h ^ (h >> 16);
+}
 
-/* ============================================================
-   Hash Map Implementation
-   ============================================================ */
+static int same_id(const OpNode *node, const char *id, size_t len)
+{
+    return memcmp(node->operator_id, id, len) == 0 && node->operator_id[len] == '\0';
+}
 
-unsigned long str_hash(const char *s)
+// Slot holding id, or the empty slot where it belongs
+static int find_op_slot(const OpTable *table, const char *id, size_t len)
 {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = (unsigned char)*s++))
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-    return hash;
+    int i = (int)(op_hash(id, len) & (unsigned)table->slot_mask);
+    while (table->slots[i] && !same_id(&table->nodes[table->slots[i] - 1], id, len))
+        i = (i + 1) & table->slot_mask;
+    return i;
 }
 
-OpNode *get_or_create_opnode(const char *operator_id, const char *operator_name)
+static int grow_op_table(OpTable *table)
 {
-    unsigned long h = str_hash(operator_id);
-    unsigned idx = (unsigned)(h % NUM_BUCKETS);
-    OpNode *node = buckets[idx];
+    int capacity = table->capacity ? table->capacity * 2 : OP_MIN_CAPACITY;
+    int nslots = capacity * 2;
+
+    OpNode *nodes = (OpNode *)realloc(table->nodes, (size_t)capacity * sizeof(OpNode));
+    if (!nodes) return -1;
+    table->nodes = nodes;
+
+    int *slots = (int *)calloc((size_t)nslots, sizeof(int));
+    if (!slots) return -1;
+    free(table->slots);
+    table->slots = slots;
+    table->slot_mask = nslots - 1;
+    table->capacity = capacity;
+
+    for (int n = 0; n < table->count; n++) {
+        const char *id = table->nodes[n].operator_id;
+        table->slots[find_op_slot(table, id, strlen(id))] = n + 1;
+    }
+    return 0;
+}
 
-    while (node)
-    {
-        if (strcmp(node->operator_id, operator_id) == 0)
-            return node;
-        node = node->next;
+// Numeric value of an operator id, for searches by code; 0 if it has none
+static int operator_code_of(const char *id, size_t len)
+{
+    char digits[32];
+    if (len >= sizeof(digits)) len = sizeof(digits) - 1;
+    memcpy(digits, id, len);
+    digits[len] = '\0';
+    return (int)to_long_or_zero(digits);
+}
+
+// Id and name are length-delimited so records can be interned straight from
+// the mapped CDR buffer; both are only copied the first time an id is seen.
+int intern_operator(OpTable *table, const char *operator_id, size_t id_len,
+                    const char *operator_name, size_t name_len)
+{
+    if (table->capacity) {
+        int slot = find_op_slot(table, operator_id, id_len);
+        if (table->slots[slot])
+            return table->slots[slot] - 1;
     }
 
-    // Create a new node
-    OpNode *newnode = (OpNode *)calloc(1, sizeof(OpNode));
-    newnode->operator_id = strdup(operator_id);
-    newnode->stats.operator_name = operator_name ? strdup(operator_name) : strdup("UNKNOWN");
-    newnode->next = buckets[idx];
-    buckets[idx] = newnode;
-    return newnode;
+    if (table->count >= OP_MAX_OPERATORS) {
+        table->full = 1;
+        return -1;
+    }
+    if (table->count == table->capacity && grow_op_table(table) != 0)
+        return -1;
+
+    // Create a new node; its id and name live in the table's arena
+    OpNode *node = &table->nodes[table->count];
+    memset(node, 0, sizeof(*node));
+    node->operator_id = arena_strndup(&table->arena, operator_id, id_len);
+    node->operator_code = operator_code_of(operator_id, id_len);
+    node->stats.operator_name = operator_name
+        ? arena_strndup(&table->arena, operator_name, name_len)
+        : arena_strndup(&table->arena, "UNKNOWN", 7);
+    if (!node->operator_id || !node->stats.operator_name) return -1;
+
+    table->slots[find_op_slot(table, operator_id, id_len)] = table->count + 1;
+    return table->count++;
+}
+
+OpNode *get_or_create_opnode(OpTable *table, const char *operator_id, const char *operator_name)
+{
+    int index = intern_operator(table, operator_id, strlen(operator_id), operator_name,
+                                operator_name ? strlen(operator_name) : 0);
+    return index < 0 ? NULL : &table->nodes[index];
+}
+
+const char *operator_name_at(const OpTable *table, int index)
+{
+    if (index < 0 || index >= table->count) return "UNKNOWN";
+    return table->nodes[index].stats.operator_name;
 }
 
 /* ============================================================
@@ -84,154 +151,375 @@ long to_long_or_zero(const char *s)
 }
 
 /* ============================================================
-   CDR Line Processor
+   CDR Record Processor
    ============================================================ */
 
-void process_line(char *line)
+int intop_add_record(OpTable *table, const CdrRecord *rec)
 {
-    chomp(line);
-    if (line[0] == '\0') return;
-
-    // Parse CDR line into tokens
-    char *tokens[12];
-    int n = split_pipe(line, tokens, 9);
-    
-    // Fill missing tokens with empty strings
-    for (int i = n; i < 9; ++i)
-        tokens[i] = "";
-
-    // Extract fields
-    const char *operator_name = tokens[1];
-    const char *operator_id = tokens[2];
-    const char *call_type = tokens[3];
-    const char *duration_s = tokens[4];
-    const char *download_s = tokens[5];
-    const char *upload_s = tokens[6];
-
     // Validate operator_id
-    if (!operator_id || operator_id[0] == '\0') return;
-    if (!call_type) return;
-
-    // Get or create operator node
-    OpNode *node = get_or_create_opnode(operator_id, operator_name);
-    OperatorStats *stats = &node->stats;
-
-    // Normalize call type to uppercase
-    char call_type_upper[32];
-    snprintf(call_type_upper, sizeof(call_type_upper), "%s", call_type);
-    for (char *p = call_type_upper; *p; ++p)
-        *p = toupper((unsigned char)*p);
-
-    // Update statistics based on call type
-    if (strcmp(call_type_upper, "MOC") == 0)
-        stats->total_moc_duration += to_long_or_zero(duration_s);
-    else if (strcmp(call_type_upper, "MTC") == 0)
-        stats->total_mtc_duration += to_long_or_zero(duration_s);
-    else if (strcmp(call_type_upper, "SMS-MO") == 0)
+    if (rec->operatorIdLen == 0) return -1;
+
+    // Get or create operator node, keyed by the id text as written
+    int index = intern_operator(table, rec->operatorId, (size_t)rec->operatorIdLen,
+                                rec->operatorName, (size_t)rec->operatorNameLen);
+    if (index < 0) return -1;
+    OperatorStats *stats = &table->nodes[index].stats;
+
+    // Update statistics based on call type (values are whole units)
+    switch (rec->callType) {
+    case CALL_MOC:
+        stats->total_moc_duration += rec->durationUnits;
+        break;
+    case CALL_MTC:
+        stats->total_mtc_duration += rec->durationUnits;
+        break;
+    case CALL_SMS_MO:
         stats->sms_mo_count++;
-    else if (strcmp(call_type_upper, "SMS-MT") == 0)
+        break;
+    case CALL_SMS_MT:
         stats->sms_mt_count++;
-    else if (strcmp(call_type_upper, "GPRS") == 0) {
-        stats->total_download += to_long_or_zero(download_s);
-        stats->total_upload += to_long_or_zero(upload_s);
+        break;
+    case CALL_GPRS:
+        stats->total_download += rec->downloadUnits;
+        stats->total_upload += rec->uploadUnits;
+        break;
+    default:
+        break;
     }
+    return index;
+}
+
+void process_line(OpTable *table, char *line)
+{
+    CdrRecord rec;
+    if (cdr_decode_line(line, &rec))
+        intop_add_record(table, &rec);
+}
+
+static void interop_sink(const CdrRecord *rec, void *ctx)
+{
+    intop_add_record((OpTable *)ctx, rec);
 }
 
 /* ============================================================
-   Helper Functions for Main Processing
+   Partial Table Merge
    ============================================================ */
 
-static void write_billing_output(FILE *fout)
-{
-    for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
-        OpNode *node = buckets[i];
-        while (node) {
-            OperatorStats *stats = &node->stats;
-            fprintf(fout, "Operator Brand: %s (%s)\n", stats->operator_name, node->operator_id);
-            fprintf(fout, "\tIncoming voice call durations: %ld\n", stats->total_mtc_duration);
-            fprintf(fout, "\tOutgoing voice call durations: %ld\n", stats->total_moc_duration);
-            fprintf(fout, "\tIncoming SMS messages: %ld\n", stats->sms_mt_count);
-            fprintf(fout, "\tOutgoing SMS messages: %ld\n", stats->sms_mo_count);
-            fprintf(fout, "\tMB Download: %ld | MB Uploaded: %ld\n", 
-                    stats->total_download, stats->total_upload);
-            fprintf(fout, "----------------------------------------\n");
-            node = node->next;
+// Fold a worker's partial table into dst, summing per operator id (first
+// seen operator name wins). remap[i] receives the dst index of partial
+// operator i so customer records can be rewritten. The partial table is
+// left empty. Returns 0 on success.
+int merge_op_table(OpTable *dst, OpTable *partial, int *remap)
+{
+    int rc = partial->full ? -1 : 0;
+    dst->full |= partial->full;
+    for (int i = 0; i < partial->count; i++) {
+        OpNode *src = &partial->nodes[i];
+        int index = intern_operator(dst, src->operator_id, strlen(src->operator_id),
+                                    src->stats.operator_name, strlen(src->stats.operator_name));
+        remap[i] = index;
+        if (index < 0) {
+            rc = -1;
+            continue;
         }
+
+        OperatorStats *stats = &dst->nodes[index].stats;
+        stats->total_moc_duration += src->stats.total_moc_duration;
+        stats->total_mtc_duration += src->stats.total_mtc_duration;
+        stats->sms_mo_count += src->stats.sms_mo_count;
+        stats->sms_mt_count += src->stats.sms_mt_count;
+        stats->total_download += src->stats.total_download;
+        stats->total_upload += src->stats.total_upload;
     }
+    free_op_table(partial);
+    return rc;
 }
 
-static void cleanup_hash_table(void)
+/* ============================================================
+   Operator Name Index
+   ============================================================ */
+
+static int compare_name_entry(const void *a, const void *b)
 {
-    for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
-        OpNode *node = buckets[i];
-        while (node) {
-            OpNode *tmp = node->next;
-            free(node->operator_id);
-            free(node->stats.operator_name);
-            free(node);
-            node = tmp;
+    const OpNameEntry *x = (const OpNameEntry *)a;
+    const OpNameEntry *y = (const OpNameEntry *)b;
+    int c = strcmp(x->folded, y->folded);
+    return c ? c : (x->index > y->index) - (x->index < y->index);
+}
+
+static void fold_name(char *dst, const char *src, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        dst[i] = (char)tolower((unsigned char)src[i]);
+    dst[len] = '\0';
+}
+
+int op_name_index_build(OpNameIndex *idx, const char *const *names, const int *codes, int count)
+{
+    memset(idx, 0, sizeof(*idx));
+    size_t total = 0;
+    for (int i = 0; i < count; i++)
+        total += strlen(names[i]) + 1;
+
+    idx->entries = (OpNameEntry *)malloc((size_t)(count > 0 ? count : 1) * sizeof(OpNameEntry));
+    idx->names = (char *)malloc(total + 1);
+    if (!idx->entries || !idx->names) {
+        op_name_index_free(idx);
+        return -1;
+    }
+
+    char *p = idx->names;
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(names[i]);
+        fold_name(p, names[i], len);
+        idx->entries[i].folded = p;
+        idx->entries[i].operator_code = codes[i];
+        idx->entries[i].index = i;
+        p += len + 1;
+    }
+    idx->count = count;
+    qsort(idx->entries, (size_t)count, sizeof(OpNameEntry), compare_name_entry);
+    return 0;
+}
+
+int op_name_index_build_table(OpNameIndex *idx, const OpTable *table)
+{
+    const char **names = (const char **)malloc((size_t)(table->count + 1) * sizeof(char *));
+    int *codes = (int *)malloc((size_t)(table->count + 1) * sizeof(int));
+    int rc = -1;
+    if (names && codes) {
+        for (int i = 0; i < table->count; i++) {
+            names[i] = table->nodes[i].stats.operator_name;
+            codes[i] = table->nodes[i].operator_code;
         }
-        buckets[i] = NULL;
+        rc = op_name_index_build(idx, names, codes, table->count);
     }
+    free(names);
+    free(codes);
+    return rc;
 }
 
-/* ============================================================
-   Main Processing Function
-   ============================================================ */
+static int compare_int(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
 
-void InteroperatorBillingProcess(const char *input_path, const char *output_path)
+// First entry whose folded name is >= key
+static int lower_bound(const OpNameIndex *idx, const char *key)
 {
-    // Open input file
-    FILE *fin = fopen(input_path, "r");
-    if (!fin) {
-        fprintf(stderr, "Error opening input file '%s': %s\n", input_path, strerror(errno));
-        return;
+    int lo = 0, hi = idx->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(idx->entries[mid].folded, key) < 0) lo = mid + 1;
+        else hi = mid;
     }
+    return lo;
+}
 
-    // Open output file
-    FILE *fout = fopen(output_path, "w");
-    if (!fout) {
-        fprintf(stderr, "Error creating output file '%s': %s\n", output_path, strerror(errno));
-        fclose(fin);
+int op_name_index_lookup(const OpNameIndex *idx, const char *query, int *matches, int max)
+{
+    char key[OP_QUERY_MAX];
+    size_t len = strlen(query);
+    if (len >= sizeof(key)) len = sizeof(key) - 1;
+    fold_name(key, query, len);
+    if (len == 0 || max <= 0) return 0;
+
+    int n = 0;
+    int first = lower_bound(idx, key);
+
+    // Exact name, or exact operator code for an all-digit term
+    for (int i = first; i < idx->count && n < max &&
+         strcmp(idx->entries[i].folded, key) == 0; i++)
+        matches[n++] = idx->entries[i].index;
+    if (strspn(key, "0123456789") == len) {
+        int code = atoi(key);
+        for (int i = 0; i < idx->count && n < max; i++) {
+            if (idx->entries[i].operator_code == code && strcmp(idx->entries[i].folded, key) != 0)
+                matches[n++] = idx->entries[i].index;
+        }
+    }
+
+    // Then names starting with the term
+    if (n == 0) {
+        for (int i = first; i < idx->count && n < max &&
+             strncmp(idx->entries[i].folded, key, len) == 0; i++)
+            matches[n++] = idx->entries[i].index;
+    }
+
+    // Then names containing it anywhere
+    if (n == 0) {
+        for (int i = 0; i < idx->count && n < max; i++) {
+            if (strstr(idx->entries[i].folded, key))
+                matches[n++] = idx->entries[i].index;
+        }
+    }
+
+    // Report order
+    qsort(matches, (size_t)n, sizeof(int), compare_int);
+    return n;
+}
+
+void op_name_index_free(OpNameIndex *idx)
+{
+    free(idx->entries);
+    free(idx->names);
+    memset(idx, 0, sizeof(*idx));
+}
+
+// Write <report>.idx for the blocks just committed to report_path. Block i
+// of the report starts at offsets[i] and is lengths[i] bytes long.
+static void write_report_index(const OpTable *table, const char *report_path,
+                               const uint64_t *offsets, const uint32_t *lengths)
+{
+    struct stat st;
+    char path[600];
+    if (stat(report_path, &st) != 0 ||
+        snprintf(path, sizeof(path), "%s%s", report_path, IOSB_INDEX_SUFFIX) >= (int)sizeof(path))
+        return;
+
+    OpNameIndex idx;
+    if (op_name_index_build_table(&idx, table) != 0) return;
+
+    IosbIndexHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, IOSB_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = IOSB_INDEX_VERSION;
+    hdr.count = (uint32_t)idx.count;
+    hdr.reportSize = (uint64_t)st.st_size;
+    hdr.reportMtimeSec = (int64_t)st.st_mtim.tv_sec;
+    hdr.reportMtimeNsec = (int64_t)st.st_mtim.tv_nsec;
+    hdr.reportIno = (uint64_t)st.st_ino;
+
+    IosbIndexEntry *entries = (IosbIndexEntry *)calloc((size_t)idx.count + 1, sizeof(IosbIndexEntry));
+    if (!entries) {
+        op_name_index_free(&idx);
         return;
     }
+    for (int i = 0; i < idx.count; i++) {
+        const OpNameEntry *e = &idx.entries[i];
+        entries[i].name_offset = (uint32_t)hdr.namesSize;
+        entries[i].name_len = (uint32_t)strlen(e->folded);
+        entries[i].operator_code = e->operator_code;
+        entries[i].block_offset = offsets[e->index];
+        entries[i].block_len = lengths[e->index];
+        hdr.namesSize += entries[i].name_len;
+    }
 
-    // Process CDR file line by line
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read;
+    OutFile out;
+    FILE *fp = outfile_open(&out, path);
+    int ok = fp != NULL &&
+             fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+             fwrite(entries, sizeof(IosbIndexEntry), (size_t)idx.count, fp) == (size_t)idx.count;
+    for (int i = 0; ok && i < idx.count; i++)
+        ok = fwrite(idx.entries[i].folded, 1, entries[i].name_len, fp) == entries[i].name_len;
+    if (ok) outfile_commit(&out);
+    else if (fp) outfile_abort(&out);
+
+    free(entries);
+    op_name_index_free(&idx);
+}
 
-    while ((read = getline(&line, &len, fin)) != -1) {
-        process_line(line);
+/* ============================================================
+   Helper Functions for Main Processing
+   ============================================================ */
+
+// One IOSB.txt operator block, from the "Operator Brand" line to the separator
+int format_operator_record(char *buf, size_t len, const OpNode *node)
+{
+    const OperatorStats *stats = &node->stats;
+    return snprintf(buf, len,
+                    "Operator Brand: %s (%s)\n"
+                    "\tIncoming voice call durations: %ld\n"
+                    "\tOutgoing voice call durations: %ld\n"
+                    "\tIncoming SMS messages: %ld\n"
+                    "\tOutgoing SMS messages: %ld\n"
+                    "\tMB Download: %ld | MB Uploaded: %ld\n"
+                    "----------------------------------------\n",
+                    stats->operator_name, node->operator_id,
+                    stats->total_mtc_duration, stats->total_moc_duration,
+                    stats->sms_mt_count, stats->sms_mo_count,
+                    stats->total_download, stats->total_upload);
+}
+
+// Optionally records where each block starts and how long it is
+static void write_billing_output(const OpTable *table, FILE *fout,
+                                 uint64_t *offsets, uint32_t *lengths)
+{
+    char block[OP_RECORD_MAX];
+    uint64_t offset = 0;
+    for (int i = 0; i < table->count; ++i) {
+        int len = format_operator_record(block, sizeof(block), &table->nodes[i]);
+        if (len >= (int)sizeof(block)) len = (int)sizeof(block) - 1;
+        fwrite(block, 1, (size_t)len, fout);
+        if (offsets) {
+            offsets[i] = offset;
+            lengths[i] = (uint32_t)len;
+        }
+        offset += (uint64_t)len;
     }
+}
+
+// Operator names are released with the arena in one go
+void free_op_table(OpTable *table)
+{
+    arena_release(&table->arena);
+    free(table->nodes);
+    free(table->slots);
+    memset(table, 0, sizeof(*table));
+}
+
+/* ============================================================
+   Main Processing Functions
+   ============================================================ */
+
+int InteroperatorBillingReport(const OpTable *table, const char *output_path)
+{
+    // Open output file
+    OutFile out;
+    FILE *fout = outfile_open(&out, output_path);
+    if (!fout) return -1;
+
+    // Write aggregated results to output file, then its name index
+    uint64_t *offsets = (uint64_t *)malloc((size_t)(table->count + 1) * sizeof(uint64_t));
+    uint32_t *lengths = (uint32_t *)malloc((size_t)(table->count + 1) * sizeof(uint32_t));
+    int indexed = offsets && lengths;
+    write_billing_output(table, fout, indexed ? offsets : NULL, lengths);
+    int rc = outfile_commit(&out);
+    if (rc == 0 && indexed)
+        write_report_index(table, output_path, offsets, lengths);
+    free(offsets);
+    free(lengths);
+    return rc;
+}
 
-    free(line);
-    fclose(fin);
+void InteroperatorBillingProcess(const char *input_path, const char *output_path)
+{
+    OpTable *table = (OpTable *)calloc(1, sizeof(OpTable));
+    if (!table) return;
 
-    // Write aggregated results to output file
-    write_billing_output(fout);
-    fclose(fout);
+    // Process CDR file record by record
+    if (cdr_ingest_file(input_path, interop_sink, table) >= 0)
+        InteroperatorBillingReport(table, output_path);
 
     // Cleanup allocated memory
-    cleanup_hash_table();
+    free_op_table(table);
+    free(table);
 }
 
 /* ============================================================
-   Thread Entry Point
+   Report Thread Entry Point
    ============================================================ */
 
-void* intopbillprocess(void *arg)
+int intopbillreport(void *arg)
 {
-    ProcessThreadArg *threadArg = (ProcessThreadArg *)arg;
+    BillingJob *job = (BillingJob *)arg;
     
-    // Build file paths
-    const char *input_file = "data/data.cdr";
+    // Build output path
     char output_file[512];
-    snprintf(output_file, sizeof(output_file), "%s/IOSB.txt",
-             threadArg ? threadArg->output_dir : "Output");
-    
-    // Process CDR and generate interoperator billing
-    InteroperatorBillingProcess(input_file, output_file);
+    snprintf(output_file, sizeof(output_file), "%s/IOSB.txt", job->output_dir);
     
-    return NULL;
+    // Write interoperator billing from the job's aggregated records;
+    // the customer report still reads operator names, the job frees them
+    return InteroperatorBillingReport(&job->operators, output_file);
 }
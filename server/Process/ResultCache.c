@@ -0,0 +1,332 @@
+// ResultCache.c - Billing results shared by every user of the same input
+// Finished runs are filed under RESULT_CACHE_DIR by the identity of the CDR
+// input (size, mtime and a hash of its content). A later run over the same
+// input hard-links the cached reports, indexes and snapshot into its output
+// directory instead of billing again. Report files are only ever replaced by
+// rename, never rewritten in place, so the links stay valid for every user.
+#include "../Header/ResultCache.h"
+#include "../Header/Snapshot.h"
+#include "../Header/config.h"
+
+// Files of one result; the indexes are optional, the rest must exist
+static const struct {
+    const char *name;
+    int required;
+} cached_files[] = {
+    { "CB.txt", 1 },
+    { "CB.txt.idx", 0 },
+    { "IOSB.txt", 1 },
+    { "IOSB.txt.idx", 0 },
+    { SNAPSHOT_FILE, 1 },
+};
+#define CACHED_FILE_COUNT ((int)(sizeof(cached_files) / sizeof(cached_files[0])))
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t cache_budget(void)
+{
+    long mb = config_long(CFG_RESULT_CACHE_MB, RESULT_CACHE_DEFAULT_MB);
+    return mb > 0 ? (size_t)mb << 20 : 0;
+}
+
+/* ============================================================
+   Input Identity
+   ============================================================ */
+
+// Hash of the last file hashed, reused while it is unchanged
+static pthread_mutex_t memo_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    int valid;
+    dev_t dev;
+    ino_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;
+} memo;
+
+static int64_t mtime_ns(const struct stat *st)
+{
+    return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+// FNV-1a over 8-byte words, bytes for the remainder
+static uint64_t hash_block(uint64_t h, const unsigned char *p, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 1099511628211ULL;
+        h ^= h >> 29;
+    }
+    for (; i < n; i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+}
+
+// Hash from offset from to the end of the file, continuing from state h;
+// both from and stop are multiples of 8. The state at stop is stored in
+// *at_stop on the way if the file reaches that far.
+static int hash_file(int fd, uint64_t from, uint64_t h, uint64_t stop,
+                     uint64_t *at_stop, uint64_t *out)
+{
+    unsigned char *buf = (unsigned char *)malloc(RESULT_CACHE_HASH_CHUNK);
+    if (!buf) return -1;
+    posix_fadvise(fd, (off_t)from, 0, POSIX_FADV_SEQUENTIAL);
+
+    uint64_t pos = from;
+    ssize_t n = 0;
+    if (stop == pos) *at_stop = h;
+    for (;;) {
+        // Whole chunks only, so no word straddles two reads
+        size_t len = 0;
+        while (len < RESULT_CACHE_HASH_CHUNK &&
+               (n = pread(fd, buf + len, RESULT_CACHE_HASH_CHUNK - len, (off_t)(pos + len))) > 0)
+            len += (size_t)n;
+        if (n < 0) break;
+
+        if (stop > pos && stop <= pos + len) {
+            size_t head = (size_t)(stop - pos);
+            h = hash_block(h, buf, head);
+            *at_stop = h;
+            h = hash_block(h, buf + head, len - head);
+        } else {
+            h = hash_block(h, buf, len);
+        }
+        pos += len;
+        if (len < RESULT_CACHE_HASH_CHUNK) break;
+    }
+    free(buf);
+    *out = h;
+    return n < 0 ? -1 : 0;
+}
+
+int result_cache_key(const char *input, ResultCacheMark *mark, uint64_t limit,
+                     ResultCacheKey *key)
+{
+    int fd = open(input, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat before, after;
+    if (fstat(fd, &before) != 0 || !S_ISREG(before.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    key->size = (uint64_t)before.st_size;
+    key->mtime_ns = mtime_ns(&before);
+
+    pthread_mutex_lock(&memo_lock);
+    int known = memo.valid && memo.dev == before.st_dev && memo.ino == before.st_ino &&
+                memo.size == key->size && memo.mtime_ns == key->mtime_ns;
+    if (known) key->hash = memo.hash;
+    pthread_mutex_unlock(&memo_lock);
+
+    if (!known) {
+        uint64_t from = 0, h = RESULT_CACHE_HASH_SEED;
+        if (mark && mark->offset > 0 && mark->offset % 8 == 0 && mark->offset <= key->size) {
+            from = mark->offset;
+            h = mark->state;
+        }
+        uint64_t stop = (limit < key->size ? limit : key->size) & ~(uint64_t)7;
+        if (stop < from) stop = from;
+        uint64_t at_stop = h;
+
+        // A file modified while it was hashed has no stable identity
+        if (hash_file(fd, from, h, stop, &at_stop, &key->hash) != 0 || fstat(fd, &after) != 0 ||
+            (uint64_t)after.st_size != key->size || mtime_ns(&after) != key->mtime_ns) {
+            close(fd);
+            return -1;
+        }
+        if (mark) {
+            mark->offset = stop;
+            mark->state = at_stop;
+        }
+        pthread_mutex_lock(&memo_lock);
+        memo.valid = 1;
+        memo.dev = before.st_dev;
+        memo.ino = before.st_ino;
+        memo.size = key->size;
+        memo.mtime_ns = key->mtime_ns;
+        memo.hash = key->hash;
+        pthread_mutex_unlock(&memo_lock);
+    }
+    close(fd);
+
+    // Results of an older snapshot and report format never match
+    snprintf(key->name, sizeof(key->name), "v%d-%llx-%llx-%016llx", SNAPSHOT_VERSION,
+             (unsigned long long)key->size, (unsigned long long)key->mtime_ns,
+             (unsigned long long)key->hash);
+    return 0;
+}
+
+int result_cache_unchanged(const char *input, const ResultCacheKey *key)
+{
+    struct stat st;
+    return stat(input, &st) == 0 && (uint64_t)st.st_size == key->size &&
+           mtime_ns(&st) == key->mtime_ns;
+}
+
+/* ============================================================
+   Entries
+   ============================================================ */
+
+static void remove_entry(const char *path)
+{
+    DIR *dir = opendir(path);
+    if (dir) {
+        struct dirent *ent;
+        char file[600];
+        while ((ent = readdir(dir)) != NULL) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+            snprintf(file, sizeof(file), "%s/%s", path, ent->d_name);
+            unlink(file);
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+static size_t entry_bytes(const char *path)
+{
+    size_t bytes = 0;
+    char file[700];
+    struct stat st;
+    for (int i = 0; i < CACHED_FILE_COUNT; i++) {
+        snprintf(file, sizeof(file), "%s/%s", path, cached_files[i].name);
+        if (stat(file, &st) == 0) bytes += (size_t)st.st_size;
+    }
+    return bytes;
+}
+
+typedef struct {
+    char name[64];
+    time_t used;
+    size_t bytes;
+} CacheEntry;
+
+static int by_last_use(const void *a, const void *b)
+{
+    time_t x = ((const CacheEntry *)a)->used, y = ((const CacheEntry *)b)->used;
+    return (x > y) - (x < y);
+}
+
+// Remove least recently used entries until the cache fits budget; cache_lock held
+static void evict_over_budget(size_t budget)
+{
+    DIR *dir = opendir(RESULT_CACHE_DIR);
+    if (!dir) return;
+
+    CacheEntry *entries = NULL;
+    size_t count = 0, capacity = 0, total = 0;
+    struct dirent *ent;
+    char path[600];
+    struct stat st;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.' || strlen(ent->d_name) >= sizeof(entries->name)) continue;
+        snprintf(path, sizeof(path), "%s/%s", RESULT_CACHE_DIR, ent->d_name);
+        if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+
+        if (count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 16;
+            CacheEntry *more = (CacheEntry *)realloc(entries, grown * sizeof(CacheEntry));
+            if (!more) break;
+            entries = more;
+            capacity = grown;
+        }
+        CacheEntry *e = &entries[count++];
+        snprintf(e->name, sizeof(e->name), "%s", ent->d_name);
+        e->used = st.st_mtime;
+        e->bytes = entry_bytes(path);
+        total += e->bytes;
+    }
+    closedir(dir);
+
+    qsort(entries, count, sizeof(CacheEntry), by_last_use);
+    for (size_t i = 0; i < count && total > budget; i++) {
+        snprintf(path, sizeof(path), "%s/%s", RESULT_CACHE_DIR, entries[i].name);
+        remove_entry(path);
+        total -= entries[i].bytes;
+    }
+    free(entries);
+}
+
+/* ============================================================
+   Fetch & Store
+   ============================================================ */
+
+int result_cache_fetch(const ResultCacheKey *key, const char *output_dir)
+{
+    if (cache_budget() == 0) return -1;
+
+    char entry[512], src[600], tmp[CACHED_FILE_COUNT][600], dst[600];
+    int linked[CACHED_FILE_COUNT];
+    snprintf(entry, sizeof(entry), "%s/%s", RESULT_CACHE_DIR, key->name);
+
+    pthread_mutex_lock(&cache_lock);
+
+    // Link everything under temporary names first, so a partial entry
+    // leaves the output directory untouched
+    int ok = 1;
+    for (int i = 0; i < CACHED_FILE_COUNT; i++) {
+        snprintf(src, sizeof(src), "%s/%s", entry, cached_files[i].name);
+        snprintf(tmp[i], sizeof(tmp[i]), "%s/.%s.cached", output_dir, cached_files[i].name);
+        unlink(tmp[i]);
+        linked[i] = link(src, tmp[i]) == 0;
+        if (!linked[i] && (cached_files[i].required || errno != ENOENT)) ok = 0;
+    }
+
+    for (int i = 0; i < CACHED_FILE_COUNT; i++) {
+        snprintf(dst, sizeof(dst), "%s/%s", output_dir, cached_files[i].name);
+        if (!ok) {
+            if (linked[i]) unlink(tmp[i]);
+        } else if (linked[i]) {
+            rename(tmp[i], dst);
+        } else {
+            unlink(dst);    // an index of an older report
+        }
+    }
+
+    // Mark the entry most recently used
+    if (ok) utimes(entry, NULL);
+    pthread_mutex_unlock(&cache_lock);
+    return ok ? 0 : -1;
+}
+
+void result_cache_store(const ResultCacheKey *key, const char *output_dir,
+                        const struct timespec *since)
+{
+    size_t budget = cache_budget();
+    if (budget == 0) return;
+
+    char entry[512], tmp[512], src[600], dst[600];
+    snprintf(entry, sizeof(entry), "%s/%s", RESULT_CACHE_DIR, key->name);
+    snprintf(tmp, sizeof(tmp), "%s/.new-%s", RESULT_CACHE_DIR, key->name);
+
+    pthread_mutex_lock(&cache_lock);
+    mkdir(RESULT_CACHE_DIR, 0755);
+
+    struct stat st;
+    if (stat(entry, &st) == 0) {
+        // Another user's run got there first
+        utimes(entry, NULL);
+        pthread_mutex_unlock(&cache_lock);
+        return;
+    }
+
+    // Assemble under a hidden name, then publish the entry with one rename
+    remove_entry(tmp);
+    int ok = mkdir(tmp, 0755) == 0;
+    for (int i = 0; ok && i < CACHED_FILE_COUNT; i++) {
+        snprintf(src, sizeof(src), "%s/%s", output_dir, cached_files[i].name);
+        snprintf(dst, sizeof(dst), "%s/%s", tmp, cached_files[i].name);
+        if (cached_files[i].required &&
+            (stat(src, &st) != 0 || mtime_ns(&st) < (int64_t)since->tv_sec * 1000000000LL + since->tv_nsec))
+            ok = 0;     // left over from an earlier run
+        else if (link(src, dst) != 0 && (cached_files[i].required || errno != ENOENT))
+            ok = 0;
+    }
+    if (!ok || rename(tmp, entry) != 0) remove_entry(tmp);
+    else evict_over_budget(budget);
+
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,239 @@
+// ResultStore.c - Resident billing results shared by all client threads
+// Every finished run, and every snapshot found at startup, is kept here per
+// output directory so searches are answered from memory. The store holds at
+// most RESULT_STORE_MB of aggregates; the least recently used results are
+// evicted first and reloaded from their snapshot on the next lookup.
+#include "../Header/ResultStore.h"
+#include "../Header/Snapshot.h"
+#include "../Header/config.h"
+
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+static BillingResult *store_head = NULL;    // most recently used first
+static size_t store_bytes = 0;              // footprint of every linked result
+
+static void free_result(BillingResult *result)
+{
+    freeCustomerTable(&result->customers);
+    free_op_table(&result->operators);
+    op_name_index_free(&result->op_index);
+    free(result);
+}
+
+static size_t store_budget(void)
+{
+    long mb = config_long(CFG_RESULT_STORE_MB, RESULT_STORE_DEFAULT_MB);
+    return mb > 0 ? (size_t)mb << 20 : 0;
+}
+
+// Heap held by a result's tables
+static size_t result_footprint(const BillingResult *result)
+{
+    const CustomerTable *c = &result->customers;
+    const OpTable *o = &result->operators;
+    size_t index_bytes = 0;
+    for (int i = 0; i < result->op_index.count; i++)
+        index_bytes += sizeof(OpNameEntry) + strlen(result->op_index.entries[i].folded) + 1;
+    return sizeof(*result) +
+           c->capacity * sizeof(CustomerSlot) + c->nchunks * sizeof(Customer *) +
+           c->arena.reserved +
+           (size_t)o->capacity * sizeof(OpNode) + (o->slots ? (size_t)(o->slot_mask + 1) * sizeof(int) : 0) +
+           o->arena.reserved + index_bytes;
+}
+
+// Unlink the entry for output_dir; store_lock must be held
+static BillingResult *unlink_entry(const char *output_dir)
+{
+    for (BillingResult **pp = &store_head; *pp; pp = &(*pp)->next) {
+        if (strcmp((*pp)->output_dir, output_dir) == 0) {
+            BillingResult *found = *pp;
+            *pp = found->next;
+            found->next = NULL;
+            store_bytes -= found->bytes;
+            return found;
+        }
+    }
+    return NULL;
+}
+
+// Drop least recently used entries until the store fits its budget; the
+// dropped entries are chained through next for the caller to release.
+// store_lock must be held.
+static BillingResult *evict_over_budget(size_t budget)
+{
+    BillingResult *evicted = NULL;
+    while (store_bytes > budget && store_head) {
+        BillingResult **pp = &store_head;
+        while ((*pp)->next)
+            pp = &(*pp)->next;
+        BillingResult *victim = *pp;
+        *pp = NULL;
+        store_bytes -= victim->bytes;
+        victim->next = evicted;
+        evicted = victim;
+    }
+    return evicted;
+}
+
+static void release_chain(BillingResult *chain)
+{
+    while (chain) {
+        BillingResult *next = chain->next;
+        result_store_release(chain);
+        chain = next;
+    }
+}
+
+// Link result as the most recent entry for its directory. With replace set
+// an existing entry is superseded; otherwise the existing one is kept and
+// result is dropped. Returns the entry now in the store with a reference
+// held for the caller, or NULL (result freed) if it exceeds the budget alone.
+static BillingResult *install(BillingResult *result, int replace)
+{
+    size_t budget = store_budget();
+    result->bytes = result_footprint(result);
+    result->refs = 2;   // the store's and the caller's
+
+    pthread_mutex_lock(&store_lock);
+    BillingResult *old = unlink_entry(result->output_dir);
+    if (old && !replace) {
+        // Keep what is already there, just mark it most recent
+        old->next = store_head;
+        store_head = old;
+        store_bytes += old->bytes;
+        old->refs++;
+        pthread_mutex_unlock(&store_lock);
+        free_result(result);
+        return old;
+    }
+
+    BillingResult *evicted = NULL;
+    int fits = result->bytes <= budget;
+    if (fits) {
+        result->next = store_head;
+        store_head = result;
+        store_bytes += result->bytes;
+        evicted = evict_over_budget(budget);
+    }
+    pthread_mutex_unlock(&store_lock);
+
+    if (old) result_store_release(old);
+    release_chain(evicted);
+    if (!fits) {
+        free_result(result);
+        return NULL;
+    }
+    return result;
+}
+
+void result_store_publish(BillingJob *job)
+{
+    BillingResult *result = (BillingResult *)calloc(1, sizeof(BillingResult));
+    if (!result) return;
+
+    snprintf(result->output_dir, sizeof(result->output_dir), "%s", job->output_dir);
+    result->records = job->records;
+    result->customers = job->customers;
+    result->operators = job->operators;
+    memset(&job->customers, 0, sizeof(job->customers));
+    memset(&job->operators, 0, sizeof(job->operators));
+    op_name_index_build_table(&result->op_index, &result->operators);
+    result_store_release(install(result, 1));
+}
+
+// Load output_dir's snapshot, unless it obviously cannot fit the budget or
+// leaves out records its reports cover (an unterminated last line), in which
+// case searches read the reports instead
+static BillingResult *load_snapshot(const char *output_dir)
+{
+    char path[512];
+    struct stat st;
+    SnapshotHeader hdr;
+    int n = snprintf(path, sizeof(path), "%s/%s", output_dir, SNAPSHOT_FILE);
+    if (n < 0 || (size_t)n >= sizeof(path) || stat(path, &st) != 0 ||
+        (size_t)st.st_size > store_budget() ||
+        snapshot_read_header(path, &hdr) != 0 || hdr.reportBytes != hdr.offset)
+        return NULL;
+
+    BillingResult *result = (BillingResult *)calloc(1, sizeof(BillingResult));
+    if (!result) return NULL;
+    snprintf(result->output_dir, sizeof(result->output_dir), "%s", output_dir);
+
+    if (snapshot_read(path, &hdr, &result->customers, &result->operators) != 0) {
+        free(result);
+        return NULL;
+    }
+    result->records = (long)hdr.records;
+    op_name_index_build_table(&result->op_index, &result->operators);
+    return result;
+}
+
+int result_store_warm_start(const char *root)
+{
+    DIR *dir = opendir(root);
+    if (!dir) return 0;
+
+    int loaded = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+
+        char output_dir[256];
+        int n = snprintf(output_dir, sizeof(output_dir), "%s/%s", root, ent->d_name);
+        if (n < 0 || (size_t)n >= sizeof(output_dir)) continue;
+
+        BillingResult *result = load_snapshot(output_dir);
+        if (!result) continue;
+        result = install(result, 0);
+        if (!result) continue;
+        result_store_release(result);
+        loaded++;
+    }
+    closedir(dir);
+    return loaded;
+}
+
+long result_store_reload(const char *output_dir)
+{
+    BillingResult *result = load_snapshot(output_dir);
+    if (result) {
+        long records = result->records;
+        result_store_release(install(result, 1));
+        return records;
+    }
+
+    pthread_mutex_lock(&store_lock);
+    BillingResult *stale = unlink_entry(output_dir);
+    pthread_mutex_unlock(&store_lock);
+    result_store_release(stale);
+    return -1;
+}
+
+BillingResult* result_store_acquire(const char *output_dir)
+{
+    pthread_mutex_lock(&store_lock);
+    BillingResult *found = unlink_entry(output_dir);
+    if (found) {
+        // Move to the front: most recently used
+        found->next = store_head;
+        store_head = found;
+        store_bytes += found->bytes;
+        found->refs++;
+    }
+    pthread_mutex_unlock(&store_lock);
+    if (found) return found;
+
+    // Evicted or never loaded: bring the snapshot back in
+    BillingResult *result = load_snapshot(output_dir);
+    return result ? install(result, 0) : NULL;
+}
+
+void result_store_release(BillingResult *result)
+{
+    if (!result) return;
+
+    pthread_mutex_lock(&store_lock);
+    int last = (--result->refs == 0);
+    pthread_mutex_unlock(&store_lock);
+
+    if (last) free_result(result);
+}
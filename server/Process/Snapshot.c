@@ -0,0 +1,231 @@
+// Snapshot.c - Persisted billing aggregates for incremental runs
+// A snapshot holds the merged customer and operator tables together with
+// the number of input bytes they cover, so a later run only has to ingest
+// records appended since, and a restarted server can serve searches
+// without reprocessing.
+#include "../Header/Snapshot.h"
+#include "../Header/outfile.h"
+
+/* ============================================================
+   Input Fingerprint
+   ============================================================ */
+
+static uint64_t fnv1a(uint64_t h, const unsigned char *p, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+}
+
+static int hash_range(int fd, uint64_t begin, uint64_t len, uint64_t *out)
+{
+    unsigned char buf[SNAPSHOT_FINGERPRINT_BYTES];
+    if (len > sizeof(buf)) len = sizeof(buf);
+    if (pread(fd, buf, (size_t)len, (off_t)begin) != (ssize_t)len) return -1;
+    *out = fnv1a(14695981039346656037ULL, buf, (size_t)len);
+    return 0;
+}
+
+// Identity of the input prefix [0, offset)
+static int input_fingerprint(const char *input, uint64_t offset, SnapshotHeader *hdr)
+{
+    int fd = open(input, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    uint64_t span = offset < SNAPSHOT_FINGERPRINT_BYTES ? offset : SNAPSHOT_FINGERPRINT_BYTES;
+    int rc = -1;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= offset &&
+        hash_range(fd, 0, span, &hdr->headHash) == 0 &&
+        hash_range(fd, offset - span, span, &hdr->tailHash) == 0) {
+        hdr->inputDev = (uint64_t)st.st_dev;
+        hdr->inputIno = (uint64_t)st.st_ino;
+        rc = 0;
+    }
+    close(fd);
+    return rc;
+}
+
+/* ============================================================
+   Load
+   ============================================================ */
+
+static int read_operators(FILE *fp, OpTable *ops, uint32_t count)
+{
+    char name[1024], id[1024];
+    for (uint32_t i = 0; i < count; i++) {
+        SnapshotOperator so;
+        if (fread(&so, sizeof(so), 1, fp) != 1 || so.nameLen >= sizeof(name) ||
+            so.idLen >= sizeof(id) || fread(name, 1, so.nameLen, fp) != so.nameLen ||
+            fread(id, 1, so.idLen, fp) != so.idLen)
+            return -1;
+
+        // Operators are restored in index order so customer opIndex stays valid
+        if (intern_operator(ops, id, so.idLen, name, so.nameLen) != (int)i)
+            return -1;
+
+        OperatorStats *stats = &ops->nodes[i].stats;
+        stats->total_moc_duration = so.stats[0];
+        stats->total_mtc_duration = so.stats[1];
+        stats->sms_mo_count = so.stats[2];
+        stats->sms_mt_count = so.stats[3];
+        stats->total_download = so.stats[4];
+        stats->total_upload = so.stats[5];
+    }
+    return 0;
+}
+
+static int read_customers(FILE *fp, CustomerTable *table, uint64_t count, uint32_t operators)
+{
+    if (reserveCustomerTable(table, (size_t)count) != 0) return -1;
+
+    for (uint64_t n = 0; n < count; n++) {
+        Customer rec;
+        if (fread(&rec, sizeof(rec), 1, fp) != 1 || rec.opIndex >= operators)
+            return -1;
+
+        Customer *cust = getCustomer(table, rec.msisdn, rec.opIndex);
+        if (!cust || table->count != n + 1) return -1;   // duplicate MSISDN
+        *cust = rec;
+    }
+    return 0;
+}
+
+static int read_header(FILE *fp, SnapshotHeader *hdr)
+{
+    return fread(hdr, sizeof(*hdr), 1, fp) == 1 &&
+           memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) == 0 &&
+           hdr->version == SNAPSHOT_VERSION &&
+           hdr->customerSize == sizeof(Customer);
+}
+
+int snapshot_read_header(const char *path, SnapshotHeader *hdr)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    int ok = read_header(fp, hdr);
+    fclose(fp);
+    return ok ? 0 : -1;
+}
+
+int snapshot_read(const char *path, SnapshotHeader *hdr,
+                  CustomerTable *customers, OpTable *operators)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+
+    int ok = read_header(fp, hdr);
+    ok = ok && read_operators(fp, operators, hdr->operatorCount) == 0 &&
+         read_customers(fp, customers, hdr->customerCount, hdr->operatorCount) == 0;
+    fclose(fp);
+
+    if (!ok) {
+        freeCustomerTable(customers);
+        free_op_table(operators);
+        return -1;
+    }
+    customers->totalRecords = (int)hdr->customerRecords;
+    return 0;
+}
+
+int snapshot_peek(const char *path, const char *input, size_t limit, SnapshotHeader *hdr)
+{
+    // The consumed prefix must still be the same bytes of the same file
+    SnapshotHeader cur;
+    memset(&cur, 0, sizeof(cur));
+    int ok = snapshot_read_header(path, hdr) == 0 && strncmp(hdr->inputPath, input, sizeof(hdr->inputPath)) == 0 &&
+         hdr->offset > 0 && hdr->offset <= limit &&
+         input_fingerprint(input, hdr->offset, &cur) == 0 &&
+         cur.inputDev == hdr->inputDev && cur.inputIno == hdr->inputIno &&
+         cur.headHash == hdr->headHash && cur.tailHash == hdr->tailHash;
+    return ok ? 0 : -1;
+}
+
+size_t snapshot_load(BillingJob *job, const char *path, size_t limit)
+{
+    SnapshotHeader hdr;
+    if (snapshot_peek(path, job->input_path, limit, &hdr) != 0 ||
+        snapshot_read(path, &hdr, &job->customers, &job->operators) != 0 ||
+        hdr.offset > limit) {
+        freeCustomerTable(&job->customers);
+        free_op_table(&job->operators);
+        job->records = 0;
+        return 0;
+    }
+
+    job->records = (long)hdr.records;
+    return (size_t)hdr.offset;
+}
+
+/* ============================================================
+   Save
+   ============================================================ */
+
+static int write_operators(FILE *fp, const OpTable *ops)
+{
+    for (int i = 0; i < ops->count; i++) {
+        const OpNode *node = &ops->nodes[i];
+        SnapshotOperator so;
+        memset(&so, 0, sizeof(so));
+        so.idLen = (uint32_t)strlen(node->operator_id);
+        so.nameLen = (uint32_t)strlen(node->stats.operator_name);
+        so.stats[0] = node->stats.total_moc_duration;
+        so.stats[1] = node->stats.total_mtc_duration;
+        so.stats[2] = node->stats.sms_mo_count;
+        so.stats[3] = node->stats.sms_mt_count;
+        so.stats[4] = node->stats.total_download;
+        so.stats[5] = node->stats.total_upload;
+        if (fwrite(&so, sizeof(so), 1, fp) != 1 ||
+            fwrite(node->stats.operator_name, 1, so.nameLen, fp) != so.nameLen ||
+            fwrite(node->operator_id, 1, so.idLen, fp) != so.idLen)
+            return -1;
+    }
+    return 0;
+}
+
+// Dense storage is written a chunk at a time, in first-seen order
+static int write_customers(FILE *fp, const CustomerTable *table)
+{
+    size_t chunk = (size_t)1 << CUST_CHUNK_SHIFT;
+    for (size_t n = 0; n < table->count; n += chunk) {
+        size_t len = table->count - n < chunk ? table->count - n : chunk;
+        if (fwrite(customerAt(table, n), sizeof(Customer), len, fp) != len)
+            return -1;
+    }
+    return 0;
+}
+
+int snapshot_save(const BillingJob *job, const char *path, size_t offset, size_t report_bytes)
+{
+    SnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.customerSize = sizeof(Customer);
+    snprintf(hdr.inputPath, sizeof(hdr.inputPath), "%s", job->input_path);
+    hdr.offset = offset;
+    hdr.reportBytes = report_bytes;
+    hdr.records = job->records;
+    hdr.customerRecords = job->customers.totalRecords;
+    hdr.customerCount = job->customers.count;
+    hdr.operatorCount = (uint32_t)job->operators.count;
+    if (job->hash_offset <= offset) {
+        hdr.hashOffset = job->hash_offset;
+        hdr.hashState = job->hash_state;
+    }
+    if (offset == 0 || input_fingerprint(job->input_path, offset, &hdr) != 0)
+        return -1;
+
+    OutFile out;
+    FILE *fp = outfile_open(&out, path);
+    if (!fp) return -1;
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        write_operators(fp, &job->operators) != 0 ||
+        write_customers(fp, &job->customers) != 0) {
+        fprintf(stderr, "Error writing snapshot '%s'\n", path);
+        outfile_abort(&out);
+        return -1;
+    }
+    return outfile_commit(&out);
+}
@@ -0,0 +1,78 @@
+// arena.c - Per-job bump allocator for customer and operator records
+#include "../Header/arena.h"
+
+static ArenaBlock* arena_new_block(Arena *arena, size_t min_size)
+{
+    // Grow geometrically so large runs need few blocks
+    size_t size = arena->head ? arena->head->size * 2 : ARENA_MIN_BLOCK;
+    if (size > ARENA_MAX_BLOCK) size = ARENA_MAX_BLOCK;
+    if (size < min_size) size = min_size;
+
+    // aligned_alloc wants a multiple of the alignment; size already is one
+    ArenaBlock *block = (ArenaBlock *)aligned_alloc(ARENA_ALIGN, sizeof(ArenaBlock) + size);
+    if (!block) return NULL;
+
+    block->size = size;
+    block->used = 0;
+    block->next = arena->head;
+    arena->head = block;
+    arena->reserved += size;
+    return block;
+}
+
+void* arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    ArenaBlock *block = arena->head;
+    if (!block || block->size - block->used < size) {
+        block = arena_new_block(arena, size);
+        if (!block) return NULL;
+    }
+
+    void *p = block->data + block->used;
+    block->used += size;
+    return p;
+}
+
+char* arena_strndup(Arena *arena, const char *s, size_t n)
+{
+    char *copy = (char *)arena_alloc(arena, n + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+void arena_adopt(Arena *dst, Arena *src)
+{
+    if (!src->head) return;
+
+    ArenaBlock *tail = src->head;
+    while (tail->next)
+        tail = tail->next;
+
+    if (dst->head) {
+        // Splice src in behind dst's current block, which stays the one
+        // new allocations bump into
+        tail->next = dst->head->next;
+        dst->head->next = src->head;
+    } else {
+        dst->head = src->head;
+    }
+    dst->reserved += src->reserved;
+    src->head = NULL;
+    src->reserved = 0;
+}
+
+void arena_release(Arena *arena)
+{
+    ArenaBlock *block = arena->head;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->reserved = 0;
+}
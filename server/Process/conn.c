@@ -0,0 +1,292 @@
+// conn.c - Buffered client connections
+// Every reply goes through one framing function and one output buffer, so a
+// menu and its prompt leave in a single write instead of one per line. A
+// client may switch the connection to typed, length-prefixed frames, so it
+// no longer has to recognize prompts and markers in the text.
+#include "../Header/conn.h"
+
+void conn_init(Conn *conn, int fd)
+{
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = fd;
+}
+
+void conn_destroy(Conn *conn)
+{
+    free(conn->in);
+    free(conn->out);
+    conn->in = conn->out = NULL;
+    conn->start = conn->end = conn->out_len = 0;
+}
+
+void conn_trim(Conn *conn)
+{
+    if (conn->start == conn->end && conn->out_len == 0)
+        conn_destroy(conn);
+}
+
+int conn_set_nonblocking(Conn *conn, int on)
+{
+    int flags = fcntl(conn->fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    flags = on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    if (fcntl(conn->fd, F_SETFL, flags) < 0) return -1;
+    conn->nonblocking = on;
+    return 0;
+}
+
+// Write as much of iov as the socket takes, resuming after partial writes.
+// Returns bytes written, or -1 on error. Stops early only on a non-blocking
+// socket that is full.
+static ssize_t writev_some(int fd, struct iovec *iov, int count)
+{
+    size_t written = 0;
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return -1;
+
+        written += (size_t)n;
+        size_t left = (size_t)n;
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return (ssize_t)written;
+}
+
+int conn_flush(Conn *conn)
+{
+    if (conn->failed) return -1;
+    if (conn->out_len == 0) return 0;
+
+    struct iovec iov = { conn->out, conn->out_len };
+    ssize_t n = writev_some(conn->fd, &iov, 1);
+    if (n < 0) {
+        conn->failed = 1;
+        return -1;
+    }
+    // Keep what a full non-blocking socket did not take
+    conn->out_len -= (size_t)n;
+    memmove(conn->out, conn->out + n, conn->out_len);
+    return conn->out_len > 0 ? 1 : 0;
+}
+
+// Queue bytes as they are, framed or not
+static int write_raw(Conn *conn, const void *buf, size_t len)
+{
+    if (conn->failed) return -1;
+    if (!conn->out && !(conn->out = (char *)malloc(CONN_OUTSIZE))) {
+        conn->failed = 1;
+        return -1;
+    }
+    if (len > CONN_OUTSIZE - conn->out_len && conn->nonblocking) {
+        // Make room by writing what the socket takes now
+        if (conn_flush(conn) < 0) return -1;
+        if (len > CONN_OUTSIZE - conn->out_len) {
+            conn->failed = 1;
+            return -1;
+        }
+    }
+    if (len <= CONN_OUTSIZE - conn->out_len) {
+        memcpy(conn->out + conn->out_len, buf, len);
+        conn->out_len += len;
+        return 0;
+    }
+
+    // Does not fit: pending output and the new data go out together
+    struct iovec iov[2] = {
+        { conn->out, conn->out_len },
+        { (void *)buf, len },
+    };
+    size_t total = conn->out_len + len;
+    conn->out_len = 0;
+    if (writev_some(conn->fd, iov, 2) != (ssize_t)total) conn->failed = 1;
+    return conn->failed ? -1 : 0;
+}
+
+int conn_frame_header(Conn *conn, int type, size_t len)
+{
+    unsigned char hdr[FRAME_HEADER] = {
+        (unsigned char)type,
+        (unsigned char)(len >> 24), (unsigned char)(len >> 16),
+        (unsigned char)(len >> 8), (unsigned char)len,
+    };
+    return write_raw(conn, hdr, sizeof(hdr));
+}
+
+int conn_write_frame(Conn *conn, int type, const void *buf, size_t len)
+{
+    if (conn_frame_header(conn, type, len) != 0) return -1;
+    return len > 0 ? write_raw(conn, buf, len) : 0;
+}
+
+int conn_write(Conn *conn, const void *buf, size_t len)
+{
+    if (conn->framed) return conn_write_frame(conn, FRAME_TEXT, buf, len);
+    return write_raw(conn, buf, len);
+}
+
+int send_line(Conn *conn, const char *s)
+{
+    size_t len = strlen(s);
+    int newline = !(len > 0 && s[len - 1] == '\n');
+    // The line and its newline make one frame
+    if (conn->framed && conn_frame_header(conn, FRAME_TEXT, len + (size_t)newline) != 0)
+        return -1;
+    if (write_raw(conn, s, len) != 0) return -1;
+    return newline ? write_raw(conn, "\n", 1) : 0;
+}
+
+int send_prompt(Conn *conn, int kind, const char *s)
+{
+    if (!conn->framed) return send_line(conn, s);
+
+    size_t len = strlen(s);
+    char k = (char)kind;
+    if (conn_frame_header(conn, FRAME_PROMPT, len + 1) != 0 || write_raw(conn, &k, 1) != 0)
+        return -1;
+    return write_raw(conn, s, len);
+}
+
+int send_error(Conn *conn, const char *fmt, ...)
+{
+    char line[CONN_LINE_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (conn->framed) return conn_write_frame(conn, FRAME_ERROR, line, strlen(line));
+    return send_line(conn, line);
+}
+
+int send_linef(Conn *conn, const char *fmt, ...)
+{
+    char line[CONN_LINE_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    return send_line(conn, line);
+}
+
+ssize_t conn_fill(Conn *conn)
+{
+    if (conn->failed) return -1;
+    if (!conn->in && !(conn->in = (char *)malloc(CONN_BUFSIZE))) return -1;
+
+    // Move unread input to the front to make room
+    if (conn->start > 0) {
+        memmove(conn->in, conn->in + conn->start, conn->end - conn->start);
+        conn->end -= conn->start;
+        conn->start = 0;
+    }
+    if (conn->end == CONN_BUFSIZE) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    ssize_t n;
+    do {
+        n = recv(conn->fd, conn->in + conn->end, CONN_BUFSIZE - conn->end, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) conn->end += (size_t)n;
+    return n;
+}
+
+// Next FRAME_TEXT as a line; a frame that can never fit fails the connection
+static ssize_t take_frame_line(Conn *conn, char *buf, size_t bufsize)
+{
+    for (;;) {
+        const unsigned char *data = (const unsigned char *)conn->in + conn->start;
+        size_t avail = conn->end - conn->start;
+        if (avail < FRAME_HEADER) return -1;
+
+        size_t len = (size_t)data[1] << 24 | (size_t)data[2] << 16 |
+                     (size_t)data[3] << 8 | (size_t)data[4];
+        if (len > CONN_BUFSIZE - FRAME_HEADER) {
+            conn->failed = 1;
+            return -1;
+        }
+        if (avail < FRAME_HEADER + len) return -1;
+        conn->start += FRAME_HEADER + len;
+        if (data[0] != FRAME_TEXT) continue;
+
+        // One line: drop the terminator and any carriage returns
+        const unsigned char *text = data + FRAME_HEADER;
+        if (len > 0 && text[len - 1] == '\n') len--;
+        size_t idx = 0;
+        for (size_t i = 0; i < len && idx < bufsize - 1; i++) {
+            if (text[i] != '\r') buf[idx++] = (char)text[i];
+        }
+        buf[idx] = '\0';
+        return (ssize_t)idx;
+    }
+}
+
+ssize_t conn_take_line(Conn *conn, char *buf, size_t bufsize)
+{
+    if (conn->start == conn->end) return -1;
+    if (conn->framed) return take_frame_line(conn, buf, bufsize);
+    char *data = conn->in + conn->start;
+    size_t avail = conn->end - conn->start;
+
+    char *nl = memchr(data, '\n', avail);
+    size_t take = nl ? (size_t)(nl - data) : avail;
+    if (take >= bufsize - 1) {
+        // Longer than the caller's buffer: hand it out in pieces
+        take = bufsize - 1;
+        nl = NULL;
+    } else if (!nl && avail < CONN_BUFSIZE) {
+        return -1;  // wait for the rest of the line
+    }
+
+    size_t idx = 0;
+    for (size_t i = 0; i < take; i++) {
+        if (data[i] != '\r') buf[idx++] = data[i];
+    }
+    buf[idx] = '\0';
+    conn->start += take + (nl ? 1 : 0);
+    return (ssize_t)idx;
+}
+
+ssize_t recv_line(Conn *conn, char *buf, size_t bufsize)
+{
+    if (conn_flush(conn) != 0) return -1;
+
+    ssize_t len;
+    while ((len = conn_take_line(conn, buf, bufsize)) < 0) {
+        if (conn_fill(conn) <= 0) return -1; // closed or error
+    }
+    return len;
+}
+
+ssize_t conn_read(Conn *conn, void *dst, size_t len)
+{
+    if (conn_flush(conn) != 0) return -1;
+
+    if (conn->start == conn->end) {
+        // Large reads bypass the buffer
+        if (len >= CONN_BUFSIZE) {
+            ssize_t n;
+            do {
+                n = recv(conn->fd, dst, len, 0);
+            } while (n < 0 && errno == EINTR);
+            return n;
+        }
+        ssize_t n = conn_fill(conn);
+        if (n <= 0) return n;
+    }
+    size_t avail = conn->end - conn->start;
+    if (len > avail) len = avail;
+    memcpy(dst, conn->in + conn->start, len);
+    conn->start += len;
+    return (ssize_t)len;
+}
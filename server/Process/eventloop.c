@@ -0,0 +1,368 @@
+// eventloop.c - Event-driven connection handling
+// Idle menu sessions cost a Session struct and an epoll registration instead
+// of a thread. Each loop thread owns an epoll instance; descriptors are armed
+// with EPOLLONESHOT so exactly one thread handles a session at a time. When
+// an input line asks for blocking work the session is parked on the worker
+// queue, run there on a blocking socket, and re-armed afterwards. Following
+// a billing job is the exception: it only waits, so the session stays on its
+// loop, which the billing pool wakes through an eventfd on every job change.
+#include "../Header/eventloop.h"
+
+typedef struct {
+    int epfd;
+    int wake_fd;                // eventfd: job progress, or followers handed over
+    pthread_t thread;
+    pthread_mutex_t lock;
+    Session *joining;           // followers handed over by workers; lock held
+    Session *followers;         // sessions following a job; loop thread only
+    int nfollowers;             // read by the pool's listener
+} EventLoop;
+
+static EventLoop *loops = NULL;
+static int loop_count = 0;
+static unsigned next_loop = 0;          // round-robin; only the accept thread uses it
+
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static Session *work_head = NULL;
+static Session *work_tail = NULL;
+
+static EventLoop *loop_of(const Session *s)
+{
+    for (int i = 0; i < loop_count; i++) {
+        if (loops[i].epfd == s->loop_fd) return &loops[i];
+    }
+    return NULL;
+}
+
+static void wake(EventLoop *loop)
+{
+    uint64_t one = 1;
+    if (write(loop->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("eventfd");
+}
+
+// Take a session off its loop's followers; loop thread only
+static void unfollow(Session *s)
+{
+    EventLoop *loop = loop_of(s);
+    for (Session **pp = &loop->followers; *pp; pp = &(*pp)->next) {
+        if (*pp == s) {
+            *pp = s->next;
+            __atomic_sub_fetch(&loop->nfollowers, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    s->following = 0;
+}
+
+static void session_close(Session *s)
+{
+    if (s->following) unfollow(s);
+    // Closing the descriptor also drops its epoll registration
+    close(s->conn.fd);
+    session_destroy(s);
+    free(s);
+}
+
+// Wait for the next input (and for room to write, if output is pending).
+// A follower only waits for room to write: its input stays buffered, as it
+// would while a thread streams the progress.
+static int session_arm(Session *s, int op)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (s->following ? 0 : EPOLLIN | EPOLLRDHUP) | EPOLLONESHOT |
+                (s->conn.out_len > 0 ? EPOLLOUT : 0);
+    ev.data.ptr = s;
+    return epoll_ctl(s->loop_fd, op, s->conn.fd, &ev);
+}
+
+// Feed whole buffered lines until blocking work is pending or none are left
+static void drain_lines(Session *s)
+{
+    char line[SESSION_INPUT_MAX];
+    while (s->connected && s->action == ACTION_NONE && !s->following &&
+           conn_take_line(&s->conn, line, sizeof(line)) >= 0)
+        session_input(s, line);
+}
+
+static void hand_off(Session *s)
+{
+    pthread_mutex_lock(&work_lock);
+    s->next = NULL;
+    if (work_tail) work_tail->next = s;
+    else work_head = s;
+    work_tail = s;
+    pthread_cond_signal(&work_ready);
+    pthread_mutex_unlock(&work_lock);
+}
+
+static void follow(Session *s);
+
+// Park the session until its next event, or end it
+static void settle(Session *s)
+{
+    if (!s->connected) {
+        conn_flush(&s->conn);   // the goodbye, as far as the socket takes it
+        session_close(s);
+        return;
+    }
+    if (s->action == ACTION_FOLLOW_JOB) {
+        follow(s);
+        return;
+    }
+    if (s->action != ACTION_NONE) {
+        hand_off(s);
+        return;
+    }
+    if (conn_flush(&s->conn) < 0) {
+        session_close(s);
+        return;
+    }
+    conn_trim(&s->conn);
+    if (session_arm(s, EPOLL_CTL_MOD) != 0) session_close(s);
+}
+
+// Start following the job the session asked for; loop thread only
+static void follow(Session *s)
+{
+    if (session_follow_start(s)) {
+        EventLoop *loop = loop_of(s);
+        s->next = loop->followers;
+        loop->followers = s;
+        __atomic_add_fetch(&loop->nfollowers, 1, __ATOMIC_RELAXED);
+    } else {
+        drain_lines(s);
+    }
+    settle(s);
+}
+
+// Queue fresh progress for every follower; those whose run is over carry
+// on with the input that waited meanwhile
+static void poll_followers(EventLoop *loop)
+{
+    Session *next;
+    for (Session *s = loop->followers; s; s = next) {
+        next = s->next;
+        if (!session_follow_poll(s)) {
+            unfollow(s);
+            drain_lines(s);
+        }
+        settle(s);
+    }
+}
+
+// Followers handed over by the workers
+static void take_joining(EventLoop *loop)
+{
+    uint64_t count;
+    if (read(loop->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("eventfd");
+
+    pthread_mutex_lock(&loop->lock);
+    Session *s = loop->joining;
+    loop->joining = NULL;
+    pthread_mutex_unlock(&loop->lock);
+
+    Session *next;
+    for (; s; s = next) {
+        next = s->next;
+        follow(s);
+    }
+}
+
+// Billing pool listener: a job changed, so wake the loops that follow one
+static void wake_followers(void)
+{
+    for (int i = 0; i < loop_count; i++) {
+        if (__atomic_load_n(&loops[i].nfollowers, __ATOMIC_RELAXED) > 0)
+            wake(&loops[i]);
+    }
+}
+
+static long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void on_event(Session *s, uint32_t events)
+{
+    if (conn_flush(&s->conn) < 0) {
+        session_close(s);
+        return;
+    }
+    if (s->following) {
+        if (events & (EPOLLHUP | EPOLLERR)) session_close(s);
+        else settle(s);
+        return;
+    }
+
+    int closed = 0;
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        while (s->connected && s->action == ACTION_NONE) {
+            ssize_t n = conn_fill(&s->conn);
+            if (n > 0) {
+                drain_lines(s);
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) closed = 1;
+            break;
+        }
+    }
+
+    // A peer that hung up still gets the action its last line asked for
+    if (closed && s->action == ACTION_NONE) {
+        session_close(s);
+        return;
+    }
+    settle(s);
+}
+
+static void* loop_main(void *arg)
+{
+    EventLoop *loop = (EventLoop *)arg;
+    struct epoll_event events[EVENT_BATCH];
+    long next_poll = 0;
+
+    for (;;) {
+        // Followers get a line at least once a second, like a blocking follow
+        int timeout = -1;
+        if (loop->followers) {
+            long left = next_poll - now_ms();
+            timeout = left > 0 ? (int)left : 0;
+        }
+
+        int n = epoll_wait(loop->epfd, events, EVENT_BATCH, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        int woken = 0;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == loop) woken = 1;
+            else on_event((Session *)events[i].data.ptr, events[i].events);
+        }
+        if (woken) take_joining(loop);
+
+        if (loop->followers && (woken || now_ms() >= next_poll)) {
+            poll_followers(loop);
+            next_poll = now_ms() + BILLING_PROGRESS_MS;
+        }
+    }
+    return NULL;
+}
+
+// Move a session that wants to follow a job from a worker to its loop
+static void join_loop(Session *s)
+{
+    EventLoop *loop = loop_of(s);
+    pthread_mutex_lock(&loop->lock);
+    s->next = loop->joining;
+    loop->joining = s;
+    pthread_mutex_unlock(&loop->lock);
+    wake(loop);
+}
+
+static void* worker_main(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&work_lock);
+        while (!work_head)
+            pthread_cond_wait(&work_ready, &work_lock);
+        Session *s = work_head;
+        work_head = s->next;
+        if (!work_head) work_tail = NULL;
+        pthread_mutex_unlock(&work_lock);
+
+        // The actions write large replies; let them block like a thread would
+        conn_set_nonblocking(&s->conn, 0);
+        while (s->connected && s->action != ACTION_NONE && s->action != ACTION_FOLLOW_JOB) {
+            session_run_action(s);
+            drain_lines(s);     // input that arrived meanwhile
+        }
+        conn_flush(&s->conn);
+        conn_set_nonblocking(&s->conn, 1);
+
+        if (!s->connected || s->conn.failed) {
+            session_close(s);
+            continue;
+        }
+        if (s->action == ACTION_FOLLOW_JOB) {
+            join_loop(s);
+            continue;
+        }
+        conn_trim(&s->conn);
+        if (session_arm(s, EPOLL_CTL_MOD) != 0) session_close(s);
+    }
+    return NULL;
+}
+
+int event_server_start(int nloops, int nworkers)
+{
+    loops = (EventLoop *)calloc((size_t)nloops, sizeof(EventLoop));
+    if (!loops) return -1;
+
+    for (int i = 0; i < nloops; i++) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = &loops[i];
+        pthread_mutex_init(&loops[i].lock, NULL);
+        loops[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+        loops[i].wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loops[i].epfd < 0 || loops[i].wake_fd < 0 ||
+            epoll_ctl(loops[i].epfd, EPOLL_CTL_ADD, loops[i].wake_fd, &ev) != 0) {
+            perror("event loop");
+            return -1;
+        }
+    }
+    // Every loop exists before any thread or listener can look one up
+    for (int i = 0; i < nloops; i++) {
+        if (pthread_create(&loops[i].thread, NULL, loop_main, &loops[i]) != 0) {
+            perror("event loop");
+            return -1;
+        }
+        pthread_detach(loops[i].thread);
+        loop_count++;
+    }
+    billing_pool_listen(wake_followers);
+
+    for (int i = 0; i < nworkers; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker_main, NULL) != 0) {
+            perror("event worker");
+            return -1;
+        }
+        pthread_detach(tid);
+    }
+    return 0;
+}
+
+int event_server_add(int fd)
+{
+    Session *s = (Session *)malloc(sizeof(Session));
+    if (!s) {
+        close(fd);
+        return -1;
+    }
+    session_init(s, fd);
+    s->loop_fd = loops[next_loop++ % (unsigned)loop_count].epfd;
+
+    // Send the main menu now; the loop takes over from the first input
+    if (conn_set_nonblocking(&s->conn, 1) != 0 || conn_flush(&s->conn) < 0) {
+        session_close(s);
+        return -1;
+    }
+    conn_trim(&s->conn);
+    if (session_arm(s, EPOLL_CTL_ADD) != 0) {
+        session_close(s);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+// outfile.c - Atomic replacement of report files
+#include "../Header/outfile.h"
+
+FILE* outfile_open(OutFile *of, const char *path)
+{
+    snprintf(of->path, sizeof(of->path), "%s", path);
+    snprintf(of->tmp_path, sizeof(of->tmp_path), "%s.XXXXXX", path);
+    of->fp = NULL;
+
+    int fd = mkstemp(of->tmp_path);
+    if (fd < 0) {
+        fprintf(stderr, "Error creating output file '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+    fchmod(fd, 0644);
+
+    of->fp = fdopen(fd, "w");
+    if (!of->fp) {
+        fprintf(stderr, "Error creating output file '%s': %s\n", path, strerror(errno));
+        close(fd);
+        unlink(of->tmp_path);
+        return NULL;
+    }
+    return of->fp;
+}
+
+int outfile_commit(OutFile *of)
+{
+    if (!of->fp) return -1;
+
+    int failed = ferror(of->fp);
+    failed |= (fclose(of->fp) != 0);
+    of->fp = NULL;
+
+    if (failed || rename(of->tmp_path, of->path) != 0) {
+        fprintf(stderr, "Error writing output file '%s': %s\n", of->path, strerror(errno));
+        unlink(of->tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+void outfile_abort(OutFile *of)
+{
+    if (of->fp) {
+        fclose(of->fp);
+        of->fp = NULL;
+    }
+    unlink(of->tmp_path);
+}
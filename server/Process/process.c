@@ -1,72 +1,599 @@
 // process.c - CDR processing coordinator
-// Spawns parallel threads for customer and interoperator billing processing
+// Runs are queued to a fixed pool of billing workers and continue in the
+// background while clients poll or follow their progress. Each run reads the
+// CDR file once on the worker's share of the cores, feeding every record to
+// both aggregators, then writes the customer and interoperator reports. Input
+// billed before, for any user, is answered from the shared result cache.
 
 #include "../Header/process.h"
 
 /* ============================================================
-   Socket Communication Helpers
+   Billing Job Context
    ============================================================ */
 
-int sendall_fd(int sock, const char *buf, size_t len) {
-    size_t total = 0;
-    while (total < len) {
-        ssize_t n = send(sock, buf + total, len - total, 0);
-        if (n <= 0) return -1;
-        total += n;
+BillingJob* billing_job_create(const char *input_path, const char *output_dir)
+{
+    BillingJob *job = (BillingJob *)calloc(1, sizeof(BillingJob));
+    if (!job) return NULL;
+
+    snprintf(job->input_path, sizeof(job->input_path), "%s", input_path);
+    snprintf(job->output_dir, sizeof(job->output_dir), "%s", output_dir);
+    return job;
+}
+
+void billing_job_destroy(BillingJob *job)
+{
+    if (!job) return;
+    freeCustomerTable(&job->customers);
+    free_op_table(&job->operators);
+    free(job);
+}
+
+// Private aggregation tables for one ingest slice
+typedef struct {
+    CustomerTable customers;
+    OpTable operators;
+} PartialTables;
+
+// Hand each decoded record to both the customer and interoperator aggregators
+static void dispatch_record(const CdrRecord *rec, void *ctx)
+{
+    PartialTables *part = (PartialTables *)ctx;
+    int opIndex = intop_add_record(&part->operators, rec);
+    addCustomerRecord(&part->customers, rec, opIndex);
+}
+
+// Ingest input bytes [begin, end) on nthreads workers and merge their
+// partial tables, in file order, into the job's tables
+static long ingest_range(BillingJob *job, size_t begin, size_t end, int nthreads)
+{
+    if (nthreads < 1) nthreads = 1;
+
+    PartialTables *parts = (PartialTables *)calloc((size_t)nthreads, sizeof(PartialTables));
+    void **ctxs = (void **)calloc((size_t)nthreads, sizeof(void *));
+    if (!parts || !ctxs) {
+        free(parts);
+        free(ctxs);
+        return -1;
     }
-    return 0;
+    // Presize the customer tables from the input size to avoid rehashing
+    size_t estimate = begin == 0 ? cdr_estimate_records(job->input_path)
+                                 : (end - begin) / CDR_AVG_RECORD_BYTES;
+    size_t expected = estimate / CUST_RECORDS_PER_CUSTOMER;
+    reserveCustomerTable(&job->customers, job->customers.count + expected);
+    for (int i = 0; i < nthreads; i++) {
+        reserveCustomerTable(&parts[i].customers, expected / (size_t)nthreads);
+        ctxs[i] = &parts[i];
+    }
+
+    long records = cdr_ingest_file_range(job->input_path, begin, end, nthreads,
+                                         dispatch_record, ctxs, &job->progress);
+
+    // Operators first: their merge yields the index remap for customers.
+    // The customer tables are then merged on every ingest thread, each
+    // owning a hash range of the customers.
+    int **remaps = (int **)calloc((size_t)nthreads, sizeof(int *));
+    CustomerTable **partials = (CustomerTable **)calloc((size_t)nthreads, sizeof(CustomerTable *));
+    int merged = 0;
+    for (int i = 0; remaps && partials && i < nthreads; i++) {
+        remaps[i] = (int *)malloc(((size_t)parts[i].operators.count + 1) * sizeof(int));
+        if (!remaps[i] || merge_op_table(&job->operators, &parts[i].operators, remaps[i]) != 0)
+            records = -1;
+        if (!remaps[i]) {
+            freeCustomerTable(&parts[i].customers);
+            continue;
+        }
+        remaps[merged] = remaps[i];
+        partials[merged++] = &parts[i].customers;
+    }
+    if (remaps && partials)
+        mergeCustomerTables(&job->customers, partials, remaps, merged, nthreads);
+    else
+        records = -1;
+
+    // Records of operators beyond the limit are in neither report
+    if (job->operators.full) {
+        fprintf(stderr, "More than %d operator ids in '%s', billing aborted\n",
+                OP_MAX_OPERATORS, job->input_path);
+        records = -1;
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        if (remaps && i < merged) free(remaps[i]);
+        freeCustomerTable(&parts[i].customers);
+        free_op_table(&parts[i].operators);
+    }
+    free(remaps);
+    free(partials);
+    free(ctxs);
+    free(parts);
+
+    if (records > 0) job->records += records;
+    return records;
 }
 
-int send_line_fd(int sock, const char *s) {
-    char tmp[BUFSIZE];
-    snprintf(tmp, sizeof(tmp), "%s\n", s);
-    return sendall_fd(sock, tmp, strlen(tmp));
+// Ingest the CDR file into the job's tables. In incremental mode the
+// aggregates of the previous run are restored from the output directory's
+// snapshot and only records appended since are read. Every run then saves
+// its snapshot up to the last complete record. An unterminated final line is
+// billed but left out of the snapshot, as it may still be being written; the
+// snapshot records that the reports cover more than it does.
+long billing_job_ingest(BillingJob *job, int nthreads)
+{
+    size_t size, complete;
+    if (cdr_file_extent(job->input_path, &size, &complete) != 0)
+        return ingest_range(job, 0, SIZE_MAX, nthreads);
+
+    int incremental = config_long(CFG_INCREMENTAL, 1) != 0;
+    char snapPath[512];
+    snprintf(snapPath, sizeof(snapPath), "%s/%s", job->output_dir, SNAPSHOT_FILE);
+
+    size_t offset = incremental ? snapshot_load(job, snapPath, complete) : 0;
+    job->input_bytes = size - offset;
+
+    long records = ingest_range(job, offset, complete, nthreads);
+    if (records < 0) return -1;
+
+    if (complete > 0)
+        snapshot_save(job, snapPath, complete, size);
+    else
+        unlink(snapPath);   // one of an earlier input would outlive these reports
+
+    job->unterminated = size > complete;
+    if (job->unterminated) {
+        long tail = ingest_range(job, complete, size, 1);
+        if (tail > 0) records += tail;
+    }
+    return records;
 }
 
 /* ============================================================
-   CDR Processing Coordinator
+   Billing Worker Pool
    ============================================================ */
 
-int processCDRdata(int client_fd, const char *output_dir) {
-    pthread_t t1, t2;
-    int rc;
-    
-    // Allocate thread arguments
-    ProcessThreadArg *arg = (ProcessThreadArg *)malloc(sizeof(ProcessThreadArg));
-    if (!arg) {
-        send_line_fd(client_fd, "Error: memory allocation failed");
-        return 0;
+// A queued, running or finished run. The pool owns it; clients refer to it
+// by id and only ever see copies of its status.
+typedef struct BillingRequest {
+    unsigned long id;
+    char output_dir[256];
+    BillingState state;
+    int status;                     // BILLING_OK or an error, once done
+    int cached;                     // results reused from the result cache
+    const char *phase;              // what a running job is doing
+    BillingJob *job;                // while running, for live progress
+    long records;                   // final figures, once done
+    size_t bytes;
+    size_t input_bytes;
+    struct timespec started;
+    struct timespec finished;
+    struct BillingRequest *next;    // queue order
+    struct BillingRequest *older;   // registry order, newest first
+} BillingRequest;
+
+// Runs are executed by a fixed set of workers, each ingesting on its share
+// of the cores; requests beyond that wait in a bounded FIFO queue, which a
+// user's next run leaves only once the previous one is done. Finished
+// requests stay listed, up to BILLING_JOB_HISTORY of them, for status queries.
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;      // workers wait here
+static pthread_cond_t pool_progress = PTHREAD_COND_INITIALIZER;  // status followers wait here
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static BillingRequest *pool_head = NULL;
+static BillingRequest *pool_tail = NULL;
+static BillingRequest *pool_jobs = NULL;    // every listed request, newest first
+static int pool_queued = 0;
+static int pool_finished = 0;
+static int pool_workers = 0;
+static int pool_idle = 0;                   // workers not running a request
+static unsigned long pool_next_id = 1;
+static void (*pool_listener)(void) = NULL;  // told of every change, see billing_pool_listen
+
+// One run per BILLING_CORES_PER_RUN cores, or per CDR_INGEST_THREADS when
+// that is set, so users are not queued behind each other on a big machine
+static int pool_worker_count(void)
+{
+    long per_run = config_long(CFG_INGEST_THREADS, BILLING_CORES_PER_RUN);
+    long fit = config_online_cpus() / (per_run > 0 ? per_run : 1);
+    long n = config_long(CFG_BILLING_WORKERS,
+                         fit > BILLING_DEFAULT_WORKERS ? fit : BILLING_DEFAULT_WORKERS);
+    return n > 0 ? (int)n : 1;
+}
+
+// Split the cores between the workers unless set explicitly
+static int pool_ingest_threads(void)
+{
+    int share = config_online_cpus() / pool_worker_count();
+    return (int)config_long(CFG_INGEST_THREADS, share > 0 ? share : 1);
+}
+
+// Wake everyone following a job; pool_lock held
+static void notify_progress(void)
+{
+    pthread_cond_broadcast(&pool_progress);
+    if (pool_listener) pool_listener();
+}
+
+static void set_phase(BillingRequest *req, const char *phase)
+{
+    pthread_mutex_lock(&pool_lock);
+    req->phase = phase;
+    notify_progress();
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// One run on the calling worker: reuse cached results for identical input,
+// or ingest, write both reports and publish
+static int run_billing(BillingRequest *req)
+{
+    // Every run gets its own job context, so concurrent users never share state
+    BillingJob *job = billing_job_create(CDR_INPUT_FILE, req->output_dir);
+    if (!job) return BILLING_ERR_MEMORY;
+
+    pthread_mutex_lock(&pool_lock);
+    req->job = job;
+    pthread_mutex_unlock(&pool_lock);
+
+    // File timestamps come from the coarse clock; anything this run writes
+    // is stamped no earlier than this
+    struct timespec started;
+    clock_gettime(CLOCK_REALTIME_COARSE, &started);
+
+    // When the user's snapshot still applies, its hash state covers the
+    // prefix, so only the bytes appended since are hashed for the key. Like
+    // the resume itself, this assumes the billed prefix was not edited.
+    char snapPath[512];
+    size_t size, complete = 0;
+    SnapshotHeader snap;
+    ResultCacheMark mark = { 0, 0 };
+    snprintf(snapPath, sizeof(snapPath), "%s/%s", req->output_dir, SNAPSHOT_FILE);
+    if (config_long(CFG_INCREMENTAL, 1) &&
+        cdr_file_extent(job->input_path, &size, &complete) == 0 &&
+        snapshot_peek(snapPath, job->input_path, complete, &snap) == 0) {
+        mark.offset = snap.hashOffset;
+        mark.state = snap.hashState;
+    }
+    ResultCacheKey key;
+    int keyed = result_cache_key(job->input_path, &mark, complete, &key) == 0;
+    if (keyed) {
+        job->hash_offset = mark.offset;
+        job->hash_state = mark.state;
     }
-    strncpy(arg->output_dir, output_dir, sizeof(arg->output_dir) - 1);
-    arg->output_dir[sizeof(arg->output_dir) - 1] = '\0';
 
-    // Inform client that processing has started
-    send_line_fd(client_fd, "Processing CDR data: started...");
+    int status = BILLING_OK;
+    int cached = keyed && result_cache_fetch(&key, req->output_dir) == 0;
+    if (cached) {
+        // Same input billed before, for this or another user
+        long records = result_store_reload(req->output_dir);
+        job->input_bytes = key.size;
+        job->progress.records = records > 0 ? records : 0;
+        job->progress.bytes = key.size;
+    } else if (billing_job_ingest(job, pool_ingest_threads()) < 0) {
+        // Single pass over the CDR file feeds both aggregators
+        status = job->operators.full ? BILLING_ERR_OPERATORS : BILLING_ERR_INPUT;
+    } else {
+        // The interoperator report is a handful of blocks; writing the two
+        // reports back to back keeps the run on this worker's cores
+        set_phase(req, "writing reports");
+        int failed = custbillreport(job) != 0;
+        failed |= intopbillreport(job) != 0;
+        if (failed) {
+            // The snapshot just saved is ahead of the reports left on disk
+            status = BILLING_ERR_OUTPUT;
+            unlink(snapPath);
+        }
+    }
 
-    rc = pthread_create(&t1, NULL, custbillprocess, arg);
-    if (rc != 0) {
-        send_line_fd(client_fd, "Error: failed to start Customer Billing processing thread");
-        free(arg);
-        return 0;
+    // Final figures outlive the job context
+    pthread_mutex_lock(&pool_lock);
+    req->cached = cached;
+    req->records = __atomic_load_n(&job->progress.records, __ATOMIC_RELAXED);
+    req->bytes = __atomic_load_n(&job->progress.bytes, __ATOMIC_RELAXED);
+    req->input_bytes = job->input_bytes;
+    req->job = NULL;
+    pthread_mutex_unlock(&pool_lock);
+
+    if (status == BILLING_OK && !cached) {
+        // Keep the aggregates resident for searches
+        result_store_publish(job);
+
+        // Share the results, unless the input changed while it was read or
+        // its snapshot leaves out an unterminated last record
+        if (keyed && !job->unterminated && result_cache_unchanged(job->input_path, &key))
+            result_cache_store(&key, req->output_dir, &started);
     }
+    billing_job_destroy(job);
+    return status;
+}
 
-    rc = pthread_create(&t2, NULL, intopbillprocess, arg);
-    if (rc != 0) {
-        send_line_fd(client_fd, "Error: failed to start Interoperator Billing processing thread");
-        // join thread 1 if needed
-        pthread_join(t1, NULL);
-        free(arg);
+// Drop the oldest finished requests beyond the history limit; pool_lock held
+static void trim_history(void)
+{
+    while (pool_finished > BILLING_JOB_HISTORY) {
+        BillingRequest **victim = NULL;
+        for (BillingRequest **pp = &pool_jobs; *pp; pp = &(*pp)->older) {
+            if ((*pp)->state == BILLING_DONE) victim = pp;
+        }
+        if (!victim) return;
+        BillingRequest *req = *victim;
+        *victim = req->older;
+        free(req);
+        pool_finished--;
+    }
+}
+
+// Whether a run for output_dir is in progress; pool_lock held
+static int dir_busy(const char *output_dir)
+{
+    for (BillingRequest *req = pool_jobs; req; req = req->older) {
+        if (req->state == BILLING_RUNNING && strcmp(req->output_dir, output_dir) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Unlink the oldest queued request whose user has no run in progress, as
+// two runs must not write the same output directory; pool_lock held
+static BillingRequest* take_request(void)
+{
+    BillingRequest *prev = NULL;
+    for (BillingRequest *req = pool_head; req; prev = req, req = req->next) {
+        if (dir_busy(req->output_dir)) continue;
+        if (prev) prev->next = req->next;
+        else pool_head = req->next;
+        if (pool_tail == req) pool_tail = prev;
+        return req;
+    }
+    return NULL;
+}
+
+static void* pool_worker(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        BillingRequest *req;
+        while (!(req = take_request()))
+            pthread_cond_wait(&pool_work, &pool_lock);
+        pool_idle--;
+        pool_queued--;
+        req->state = BILLING_RUNNING;
+        req->phase = "reading CDRs";
+        clock_gettime(CLOCK_MONOTONIC, &req->started);
+        notify_progress();
+        pthread_mutex_unlock(&pool_lock);
+
+        int status = run_billing(req);
+
+        pthread_mutex_lock(&pool_lock);
+        req->status = status;
+        req->state = BILLING_DONE;
+        clock_gettime(CLOCK_MONOTONIC, &req->finished);
+        pool_idle++;
+        pool_finished++;
+        trim_history();
+        // A request held back for this user may be taken now
+        if (pool_head) pthread_cond_broadcast(&pool_work);
+        notify_progress();
+        pthread_mutex_unlock(&pool_lock);
+    }
+    return NULL;
+}
+
+static void pool_start(void)
+{
+    int n = pool_worker_count();
+    for (int i = 0; i < n; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, pool_worker, NULL) != 0) break;
+        pthread_detach(tid);
+        pthread_mutex_lock(&pool_lock);
+        pool_workers++;
+        pool_idle++;
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+unsigned long billing_pool_submit(const char *output_dir)
+{
+    pthread_once(&pool_once, pool_start);
+
+    BillingRequest *req = (BillingRequest *)calloc(1, sizeof(BillingRequest));
+    if (!req) return 0;
+    snprintf(req->output_dir, sizeof(req->output_dir), "%s", output_dir);
+    req->state = BILLING_QUEUED;
+
+    long depth = config_long(CFG_BILLING_QUEUE, BILLING_DEFAULT_QUEUE);
+    pthread_mutex_lock(&pool_lock);
+    if (pool_workers == 0 || pool_queued >= depth) {
+        pthread_mutex_unlock(&pool_lock);
+        free(req);
         return 0;
     }
+    req->id = pool_next_id++;
+    req->older = pool_jobs;
+    pool_jobs = req;
+    if (pool_tail) pool_tail->next = req;
+    else pool_head = req;
+    pool_tail = req;
+    pool_queued++;
+    pthread_cond_signal(&pool_work);
+    pthread_mutex_unlock(&pool_lock);
+    return req->id;
+}
 
-    // Optionally, while waiting, we could stream progress updates. For now just join.
-    pthread_join(t1, NULL);
-    pthread_join(t2, NULL);
-    
-    // Free allocated argument
-    free(arg);
+static double seconds_between(const struct timespec *a, const struct timespec *b)
+{
+    return (double)(b->tv_sec - a->tv_sec) + (double)(b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+// Copy a request's status; pool_lock held
+static void read_status(const BillingRequest *req, BillingJobStatus *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->id = req->id;
+    st->state = req->state;
+    st->status = req->status;
+    st->cached = req->cached;
+    st->phase = req->phase;
+
+    if (req->state == BILLING_QUEUED) {
+        // Requests an idle worker is about to take count as running,
+        // unless the user's previous run is still going
+        long ahead = -pool_idle;
+        for (const BillingRequest *r = pool_head; r && r != req; r = r->next)
+            ahead++;
+        if (ahead < 0 && dir_busy(req->output_dir)) ahead = 0;
+        st->position = ahead < 0 ? 0 : (int)ahead + 1;   // 0: about to start
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (req->state == BILLING_DONE) {
+        st->records = req->records;
+        st->bytes = req->bytes;
+        st->input_bytes = req->input_bytes;
+        st->elapsed = seconds_between(&req->started, &req->finished);
+    } else {
+        if (req->job) {
+            st->records = __atomic_load_n(&req->job->progress.records, __ATOMIC_RELAXED);
+            st->bytes = __atomic_load_n(&req->job->progress.bytes, __ATOMIC_RELAXED);
+            st->input_bytes = req->job->input_bytes;
+        } else {
+            st->records = req->records;
+            st->bytes = req->bytes;
+            st->input_bytes = req->input_bytes;
+        }
+        st->elapsed = seconds_between(&req->started, &now);
+    }
+}
+
+int billing_pool_status(const char *output_dir, unsigned long id, BillingJobStatus *st)
+{
+    int rc = -1;
+    pthread_mutex_lock(&pool_lock);
+    for (BillingRequest *req = pool_jobs; req; req = req->older) {
+        if (strcmp(req->output_dir, output_dir) != 0) continue;
+        if (id == 0 || req->id == id) {
+            read_status(req, st);
+            rc = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return rc;
+}
+
+void billing_pool_listen(void (*listener)(void))
+{
+    pthread_mutex_lock(&pool_lock);
+    pool_listener = listener;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void billing_pool_wait(int timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
 
-    // Both parts done
-    send_line_fd(client_fd, "Processing CDR data: completed.");
+    pthread_mutex_lock(&pool_lock);
+    pthread_cond_timedwait(&pool_progress, &pool_lock, &deadline);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static const char* billing_error_text(int status)
+{
+    switch (status) {
+    case BILLING_ERR_MEMORY:
+        return "memory allocation failed";
+    case BILLING_ERR_OPERATORS:
+        return "too many operators in CDR data file";
+    case BILLING_ERR_OUTPUT:
+        return "failed to write the reports";
+    default:
+        return "failed to read CDR data file";
+    }
+}
+
+void billing_status_format(const BillingJobStatus *st, char *buf, size_t len)
+{
+    double rate = st->elapsed > 0 ? (double)st->records / st->elapsed : 0;
+
+    if (st->state == BILLING_QUEUED && st->position == 0) {
+        snprintf(buf, len, "Job %lu: starting", st->id);
+    } else if (st->state == BILLING_QUEUED) {
+        snprintf(buf, len, "Job %lu: queued, position %d", st->id, st->position);
+    } else if (st->state == BILLING_RUNNING && st->input_bytes > 0) {
+        snprintf(buf, len, "Job %lu: running (%s), %ld records, %.1f of %.1f MB (%d%%), %.0f records/s",
+                 st->id, st->phase, st->records, st->bytes / 1048576.0, st->input_bytes / 1048576.0,
+                 (int)(st->bytes * 100 / st->input_bytes), rate);
+    } else if (st->state == BILLING_RUNNING) {
+        snprintf(buf, len, "Job %lu: running (%s), %ld records", st->id, st->phase, st->records);
+    } else if (st->status == BILLING_OK && st->cached) {
+        snprintf(buf, len, "Job %lu: completed from cached results, %ld records in %.2f s",
+                 st->id, st->records, st->elapsed);
+    } else if (st->status == BILLING_OK) {
+        snprintf(buf, len, "Job %lu: completed, %ld records in %.2f s (%.0f records/s)",
+                 st->id, st->records, st->elapsed, rate);
+    } else {
+        snprintf(buf, len, "Job %lu: failed: %s", st->id, billing_error_text(st->status));
+    }
+}
+
+/* ============================================================
+   CDR Processing Coordinator
+   ============================================================ */
+
+int processCDRdata(Conn *conn, const char *output_dir) {
+    unsigned long id = billing_pool_submit(output_dir);
+    if (id == 0) {
+        send_line(conn, "Server busy: the billing queue is full. Please try again later.");
+        return 0;
+    }
+
+    // The run continues in the background; the session stays usable
+    char line[BILLING_STATUS_MAX];
+    BillingJobStatus st;
+    send_linef(conn, "Processing CDR data: submitted as job %lu.", id);
+    if (billing_pool_status(output_dir, id, &st) == 0) {
+        billing_status_format(&st, line, sizeof(line));
+        send_line(conn, line);
+    }
     return 1;
 }
+
+int follow_billing_step(Conn *conn, const char *output_dir, unsigned long *id,
+                        char *last, size_t len)
+{
+    char line[BILLING_STATUS_MAX];
+    BillingJobStatus st;
+    if (billing_pool_status(output_dir, *id, &st) != 0) return last[0] ? 0 : -1;
+    *id = st.id;
+
+    billing_status_format(&st, line, sizeof(line));
+    if (strcmp(line, last) != 0) {
+        send_line(conn, line);
+        snprintf(last, len, "%s", line);
+    }
+    return st.state == BILLING_DONE ? 0 : 1;
+}
+
+int follow_billing_job(Conn *conn, const char *output_dir, unsigned long id)
+{
+    char last[BILLING_STATUS_MAX] = "";
+    int rc = follow_billing_step(conn, output_dir, &id, last, sizeof(last));
+    if (rc < 0) return -1;
+
+    // A line per change, and at least once a second while running
+    while (conn_flush(conn) == 0 && rc > 0) {
+        billing_pool_wait(BILLING_PROGRESS_MS);
+        rc = follow_billing_step(conn, output_dir, &id, last, sizeof(last));
+    }
+    return 0;
+}
@@ -0,0 +1,639 @@
+// session.c - Client menu state machine
+// Each input line advances the session by one step and queues the replies,
+// so a session can be driven by a thread blocking in recv_line() or resumed
+// by an event loop whenever a line arrives. In multi-query mode a session
+// stays open after each search, and its resume token lets a reconnecting
+// client skip the login.
+#include "../Header/session.h"
+
+/* ============================================================
+   Menus
+   ============================================================ */
+
+static void send_menu(Session *s)
+{
+    Conn *conn = &s->conn;
+    switch (s->state) {
+    case MAIN:
+        send_line(conn, "-- MAIN MENU --");
+        send_line(conn, "1) Signup");
+        send_line(conn, "2) Login");
+        send_line(conn, "3) Exit");
+        if (s->multi_query) {
+            send_line(conn, "4) Resume session");
+            send_prompt(conn, PROMPT_LINE, "Enter choice (1-4):");
+            return;
+        }
+        break;
+    case SECOND:
+        send_line(conn, "-- SECONDARY MENU --");
+        send_line(conn, "1) Process the CDR data");
+        send_line(conn, "2) Print and search");
+        send_line(conn, "3) Logout");
+        send_line(conn, "4) Billing job status");
+        send_line(conn, "5) Follow billing job progress");
+        send_prompt(conn, PROMPT_LINE, "Enter choice (1-5):");
+        return;
+    case BILLING:
+        send_line(conn, "-- PRINT & SEARCH MENU --");
+        send_line(conn, "1) Customer Billing");
+        send_line(conn, "2) Interoperator Billing");
+        send_line(conn, "3) Back");
+        break;
+    case CUST_BILL:
+        send_line(conn, "-- CUSTOMER BILLING --");
+        send_line(conn, "1) Search by msisdn no");
+        send_line(conn, "2) Print file content of CB.txt");
+        send_line(conn, "3) Back");
+        send_line(conn, "4) Batch search by msisdn list");
+        send_prompt(conn, PROMPT_LINE, "Enter choice (1-4):");
+        return;
+    case INTER_BILL:
+        send_line(conn, "-- INTEROP BILLING --");
+        send_line(conn, "1) Search by operator name");
+        send_line(conn, "2) Print file content of IOSB.txt");
+        send_line(conn, "3) Back");
+        break;
+    }
+    send_prompt(conn, PROMPT_LINE, "Enter choice (1-3):");
+}
+
+void session_init(Session *s, int fd)
+{
+    memset(s, 0, sizeof(*s));
+    conn_init(&s->conn, fd);
+    s->state = MAIN;
+    s->step = STEP_CHOICE;
+    s->connected = 1;
+    s->loop_fd = -1;
+    s->multi_query = config_long(CFG_MULTI_QUERY, 0) != 0;
+    send_menu(s);
+}
+
+static void clear_batch(Session *s)
+{
+    free(s->batch);
+    s->batch = NULL;
+    s->batch_count = 0;
+    s->batch_capacity = 0;
+    s->batch_skipped = 0;
+}
+
+void session_destroy(Session *s)
+{
+    clear_batch(s);
+    conn_destroy(&s->conn);
+}
+
+// Searches end the session, as the menu promises, unless it takes several
+static void finish_operation(Session *s)
+{
+    if (s->multi_query) {
+        send_line(&s->conn, "Operation completed.");
+        return;
+    }
+    send_line(&s->conn, "Operation completed. Disconnecting...");
+    s->connected = 0;
+}
+
+/* ============================================================
+   Resume Tokens
+   ============================================================ */
+
+// A token stands for a logged-in user until it expires or is revoked at
+// logout; dropping the connection leaves it valid
+typedef struct SessionToken {
+    char token[SESSION_TOKEN_BYTES * 2 + 1];
+    char user[EMAIL_MAX];
+    time_t expires;
+    struct SessionToken *next;          // most recently issued first
+} SessionToken;
+
+static pthread_mutex_t token_lock = PTHREAD_MUTEX_INITIALIZER;
+static SessionToken *tokens = NULL;
+
+static time_t token_ttl(void)
+{
+    return (time_t)config_long(CFG_SESSION_TTL, SESSION_TOKEN_TTL);
+}
+
+// Compare without an early exit, so timing tells nothing about a guess
+static int token_equal(const char *a, const char *b)
+{
+    unsigned char diff = 0;
+    for (int i = 0; i < SESSION_TOKEN_BYTES * 2; i++)
+        diff |= (unsigned char)(a[i] ^ b[i]);
+    return diff == 0;
+}
+
+// Drop expired tokens, then the oldest beyond the limit; token_lock held
+static void prune_tokens(time_t now)
+{
+    int kept = 0;
+    SessionToken **pp = &tokens;
+    while (*pp) {
+        SessionToken *t = *pp;
+        if (t->expires <= now || kept >= SESSION_TOKEN_MAX) {
+            *pp = t->next;
+            free(t);
+        } else {
+            kept++;
+            pp = &t->next;
+        }
+    }
+}
+
+static int issue_token(Session *s)
+{
+    unsigned char raw[SESSION_TOKEN_BYTES];
+    if (getrandom(raw, sizeof(raw), 0) != (ssize_t)sizeof(raw)) return -1;
+
+    SessionToken *t = (SessionToken *)calloc(1, sizeof(SessionToken));
+    if (!t) return -1;
+    for (int i = 0; i < SESSION_TOKEN_BYTES; i++)
+        snprintf(t->token + i * 2, 3, "%02x", raw[i]);
+    snprintf(t->user, sizeof(t->user), "%s", s->logged_in_user);
+
+    time_t now = time(NULL);
+    t->expires = now + token_ttl();
+    pthread_mutex_lock(&token_lock);
+    t->next = tokens;
+    tokens = t;
+    prune_tokens(now);
+    pthread_mutex_unlock(&token_lock);
+
+    snprintf(s->token, sizeof(s->token), "%s", t->token);
+    return 0;
+}
+
+// Copy the user of a live token into user and extend it. Returns 0, or -1.
+static int redeem_token(const char *token, char *user, size_t len)
+{
+    if (strlen(token) != SESSION_TOKEN_BYTES * 2) return -1;
+
+    int rc = -1;
+    time_t now = time(NULL);
+    pthread_mutex_lock(&token_lock);
+    prune_tokens(now);
+    for (SessionToken *t = tokens; t; t = t->next) {
+        if (token_equal(t->token, token)) {
+            snprintf(user, len, "%s", t->user);
+            t->expires = now + token_ttl();
+            rc = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&token_lock);
+    return rc;
+}
+
+static void revoke_token(Session *s)
+{
+    if (s->token[0] == '\0') return;
+
+    pthread_mutex_lock(&token_lock);
+    for (SessionToken **pp = &tokens; *pp; pp = &(*pp)->next) {
+        if (strcmp((*pp)->token, s->token) == 0) {
+            SessionToken *t = *pp;
+            *pp = t->next;
+            free(t);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&token_lock);
+    s->token[0] = '\0';
+}
+
+/* ============================================================
+   Input Steps
+   ============================================================ */
+
+static void main_choice(Session *s, const char *choice)
+{
+    if (strcmp(choice, "1") == 0) {  // Signup
+        send_prompt(&s->conn, PROMPT_LINE, "Enter email:");
+        s->step = STEP_SIGNUP_EMAIL;
+    } else if (strcmp(choice, "2") == 0) {  // Login
+        send_prompt(&s->conn, PROMPT_LINE, "Enter email:");
+        s->step = STEP_LOGIN_EMAIL;
+    } else if (strcmp(choice, "3") == 0) {
+        send_line(&s->conn, "Goodbye. Closing connection.");
+        s->connected = 0;
+    } else if (s->multi_query && strcmp(choice, "4") == 0) {  // Resume
+        send_prompt(&s->conn, PROMPT_LINE, "Enter session token:");
+        s->step = STEP_RESUME_TOKEN;
+    } else {
+        send_error(&s->conn, "Invalid choice. Try again.");
+    }
+}
+
+static void signup_email(Session *s, const char *email)
+{
+    if (!is_valid_email(email)) {
+        send_error(&s->conn, "Invalid email format. Returning to main menu.");
+        s->step = STEP_CHOICE;
+        return;
+    }
+    snprintf(s->email, sizeof(s->email), "%s", email);
+    send_prompt(&s->conn, PROMPT_SECRET, "Enter password (min 6 chars, must include: uppercase, lowercase, digit, special char):");
+    s->step = STEP_SIGNUP_PASSWORD;
+}
+
+static void signup_password(Session *s, const char *password)
+{
+    s->step = STEP_CHOICE;
+
+    // Validate password (strong validation from auth module)
+    if (!is_valid_password(password)) {
+        send_error(&s->conn, "Invalid password. Must be at least 6 characters with uppercase, lowercase, digit, and special character. Returning to main menu.");
+        return;
+    }
+
+    // Save user (auth module checks for duplicates)
+    int result = save_user(s->email, password);
+    if (result == 1) {
+        send_line(&s->conn, "Signup successful! Please login.");
+    } else if (result == -1) {
+        send_error(&s->conn, "Email already registered. Please login or use a different email.");
+    } else {
+        send_error(&s->conn, "Error creating account. Please try again.");
+    }
+}
+
+static void login_email(Session *s, const char *email)
+{
+    if (!is_valid_email(email)) {
+        send_error(&s->conn, "Invalid email format. Returning to main menu.");
+        s->step = STEP_CHOICE;
+        return;
+    }
+    snprintf(s->email, sizeof(s->email), "%s", email);
+    send_prompt(&s->conn, PROMPT_SECRET, "Enter password:");
+    s->step = STEP_LOGIN_PASSWORD;
+}
+
+// Open the account of email: its output directory and the secondary menu
+static void enter_account(Session *s, const char *email)
+{
+    snprintf(s->logged_in_user, sizeof(s->logged_in_user), "%s", email);
+
+    // Create user-specific output directory: Output/<sanitized_email>/
+    char sanitized[EMAIL_MAX];
+    snprintf(sanitized, sizeof(sanitized), "%s", email);
+    // Replace @ and . with _ for safe directory name
+    for (int i = 0; sanitized[i]; i++) {
+        if (sanitized[i] == '@' || sanitized[i] == '.') {
+            sanitized[i] = '_';
+        }
+    }
+    snprintf(s->user_output_dir, sizeof(s->user_output_dir), "Output/%s", sanitized);
+
+    // Create the directory (mkdir returns 0 on success, -1 if exists or error)
+    mkdir(s->user_output_dir, 0755);
+    s->state = SECOND;
+}
+
+static void login_password(Session *s, const char *password)
+{
+    s->step = STEP_CHOICE;
+    if (!verify_user(s->email, password)) {
+        send_error(&s->conn, "Invalid credentials. Returning to main menu.");
+        return;
+    }
+    enter_account(s, s->email);
+    send_line(&s->conn, "Login successful. Welcome!");
+
+    // Lets a dropped connection come back without logging in again
+    if (s->multi_query && issue_token(s) == 0)
+        send_linef(&s->conn, "Session token: %s", s->token);
+}
+
+static void resume_token(Session *s, const char *token)
+{
+    char user[EMAIL_MAX];
+    s->step = STEP_CHOICE;
+    if (redeem_token(token, user, sizeof(user)) != 0) {
+        send_error(&s->conn, "Invalid or expired session token. Returning to main menu.");
+        return;
+    }
+    enter_account(s, user);
+    snprintf(s->token, sizeof(s->token), "%s", token);
+    send_linef(&s->conn, "Session resumed. Welcome back, %s!", user);
+}
+
+// Choices of the menus after login; the same three slots everywhere, plus
+// the billing job options of the secondary menu
+static void menu_choice(Session *s, const char *choice)
+{
+    char last = s->state == SECOND ? '5' : s->state == CUST_BILL ? '4' : '3';
+    int c = (strlen(choice) == 1 && choice[0] >= '1' && choice[0] <= last) ? choice[0] - '0' : 0;
+    if (c == 0) {
+        send_error(&s->conn, "Invalid choice. Try again.");
+        return;
+    }
+
+    switch (s->state) {
+    case SECOND:
+        if (c == 1) {
+            s->action = ACTION_PROCESS;
+        } else if (c == 2) {
+            s->state = BILLING;
+        } else if (c == 3) {
+            revoke_token(s);
+            s->state = MAIN; // back to main menu
+        } else {
+            send_prompt(&s->conn, PROMPT_LINE, "Enter job ID (0 for your latest job):");
+            s->step = c == 4 ? STEP_JOB_STATUS : STEP_JOB_FOLLOW;
+        }
+        break;
+    case BILLING:
+        s->state = c == 1 ? CUST_BILL : c == 2 ? INTER_BILL : SECOND;
+        break;
+    case CUST_BILL:
+        if (c == 1) {
+            send_prompt(&s->conn, PROMPT_LINE, "Enter MSISDN to search:");
+            s->step = STEP_MSISDN;
+        } else if (c == 2) {
+            s->action = ACTION_DISPLAY_CB;
+        } else if (c == 3) {
+            s->state = BILLING;
+        } else {
+            send_prompt(&s->conn, PROMPT_LIST, "Enter MSISDNs, one per line, then " SESSION_BATCH_END " to finish:");
+            clear_batch(s);
+            s->step = STEP_BATCH_MSISDN;
+        }
+        break;
+    case INTER_BILL:
+        if (c == 1) {
+            send_prompt(&s->conn, PROMPT_LINE, "Enter operator name to search:");
+            s->step = STEP_OPERATOR;
+        } else if (c == 2) {
+            s->action = ACTION_DISPLAY_IOSB;
+        } else {
+            s->state = BILLING;
+        }
+        break;
+    case MAIN:
+        break;
+    }
+}
+
+// Parse a job ID answer; 0 stands for the latest job
+static int parse_job_id(const char *line, unsigned long *id)
+{
+    char *end;
+    if (line[0] < '0' || line[0] > '9') return -1;
+    *id = strtoul(line, &end, 10);
+    return *end == '\0' ? 0 : -1;
+}
+
+static void job_status(Session *s, const char *line)
+{
+    unsigned long id;
+    BillingJobStatus st;
+    char status[BILLING_STATUS_MAX];
+
+    if (parse_job_id(line, &id) != 0) {
+        send_error(&s->conn, "Invalid job ID.");
+    } else if (billing_pool_status(s->user_output_dir, id, &st) != 0) {
+        send_error(&s->conn, "No such billing job.");
+    } else {
+        billing_status_format(&st, status, sizeof(status));
+        send_line(&s->conn, status);
+    }
+}
+
+// Collect one line of a batch upload; nothing is sent until its end
+static void batch_line(Session *s, const char *line)
+{
+    if (strcmp(line, SESSION_BATCH_END) == 0) {
+        s->step = STEP_CHOICE;
+        if (s->batch_skipped > 0)
+            send_linef(&s->conn, "Skipped %zu invalid or excess MSISDN line(s).", s->batch_skipped);
+        if (s->batch_count == 0) {
+            send_line(&s->conn, "No MSISDNs to search.");
+            clear_batch(s);
+            return;
+        }
+        s->action = ACTION_BATCH_MSISDN;
+        return;
+    }
+
+    long msisdn = atol(line);
+    if (msisdn <= 0 || s->batch_count >= SESSION_BATCH_MAX) {
+        s->batch_skipped++;
+        return;
+    }
+    if (s->batch_count == s->batch_capacity) {
+        size_t grown = s->batch_capacity ? s->batch_capacity * 2 : 256;
+        long *more = (long *)realloc(s->batch, grown * sizeof(long));
+        if (!more) {
+            s->batch_skipped++;
+            return;
+        }
+        s->batch = more;
+        s->batch_capacity = grown;
+    }
+    s->batch[s->batch_count++] = msisdn;
+}
+
+// "CLIENT_CAPS: deflate frames" announces what the client supports. It may
+// come before the first choice and is not answered, except that "frames" is
+// acknowledged with a last text line; the menu is then repeated as frames.
+static int client_caps(Session *s, const char *line)
+{
+    const char *prefix = "CLIENT_CAPS:";
+    if (s->state != MAIN || s->step != STEP_CHOICE || strncmp(line, prefix, strlen(prefix)) != 0)
+        return 0;
+
+    char caps[SESSION_INPUT_MAX];
+    snprintf(caps, sizeof(caps), "%s", line + strlen(prefix));
+    char *save = NULL;
+    int frames = 0;
+    for (char *cap = strtok_r(caps, " ,", &save); cap; cap = strtok_r(NULL, " ,", &save)) {
+        if (strcmp(cap, "deflate") == 0) s->conn.caps |= CONN_CAP_DEFLATE;
+        else if (strcmp(cap, "frames") == 0) frames = 1;
+    }
+    if (frames && !s->conn.framed) {
+        send_line(&s->conn, SESSION_FRAMES_ON);
+        s->conn.framed = 1;
+        send_menu(s);
+    }
+    return 1;
+}
+
+void session_input(Session *s, const char *line)
+{
+    if (client_caps(s, line)) return;
+
+    // An empty line ends the session; within an upload it is just skipped
+    if (line[0] == '\0' && s->step == STEP_BATCH_MSISDN) return;
+    if (line[0] == '\0') {
+        s->connected = 0;
+        return;
+    }
+
+    switch (s->step) {
+    case STEP_CHOICE:
+        if (s->state == MAIN) main_choice(s, line);
+        else menu_choice(s, line);
+        break;
+    case STEP_SIGNUP_EMAIL:
+        signup_email(s, line);
+        break;
+    case STEP_SIGNUP_PASSWORD:
+        signup_password(s, line);
+        break;
+    case STEP_LOGIN_EMAIL:
+        login_email(s, line);
+        break;
+    case STEP_LOGIN_PASSWORD:
+        login_password(s, line);
+        break;
+    case STEP_MSISDN:
+        s->step = STEP_CHOICE;
+        if (atol(line) <= 0) {
+            send_error(&s->conn, "Invalid MSISDN. Please enter a valid number.");
+            finish_operation(s);
+            return;
+        }
+        s->action = ACTION_SEARCH_MSISDN;
+        snprintf(s->arg, sizeof(s->arg), "%s", line);
+        break;
+    case STEP_OPERATOR:
+        s->step = STEP_CHOICE;
+        s->action = ACTION_SEARCH_OPERATOR;
+        snprintf(s->arg, sizeof(s->arg), "%s", line);
+        break;
+    case STEP_JOB_STATUS:
+        s->step = STEP_CHOICE;
+        job_status(s, line);
+        break;
+    case STEP_BATCH_MSISDN:
+        batch_line(s, line);
+        break;
+    case STEP_RESUME_TOKEN:
+        resume_token(s, line);
+        break;
+    case STEP_JOB_FOLLOW: {
+        unsigned long id;
+        s->step = STEP_CHOICE;
+        if (parse_job_id(line, &id) != 0) {
+            send_error(&s->conn, "Invalid job ID.");
+            break;
+        }
+        s->action = ACTION_FOLLOW_JOB;
+        snprintf(s->arg, sizeof(s->arg), "%lu", id);
+        break;
+    }
+    }
+
+    if (s->connected && s->step == STEP_CHOICE && s->action == ACTION_NONE)
+        send_menu(s);
+}
+
+/* ============================================================
+   Following a Job Without Blocking
+   ============================================================ */
+
+int session_follow_start(Session *s)
+{
+    s->action = ACTION_NONE;
+    s->follow_id = strtoul(s->arg, NULL, 10);
+    s->follow_line[0] = '\0';
+    int rc = follow_billing_step(&s->conn, s->user_output_dir, &s->follow_id,
+                                 s->follow_line, sizeof(s->follow_line));
+    if (rc < 0) send_error(&s->conn, "No such billing job.");
+    s->following = rc > 0;
+    if (!s->following) send_menu(s);
+    return s->following;
+}
+
+int session_follow_poll(Session *s)
+{
+    if (follow_billing_step(&s->conn, s->user_output_dir, &s->follow_id,
+                            s->follow_line, sizeof(s->follow_line)) > 0)
+        return 1;
+    s->following = 0;
+    send_menu(s);
+    return 0;
+}
+
+/* ============================================================
+   Blocking Actions
+   ============================================================ */
+
+void session_run_action(Session *s)
+{
+    Conn *conn = &s->conn;
+    char path[300];
+    SessionAction action = s->action;
+    s->action = ACTION_NONE;
+
+    switch (action) {
+    case ACTION_NONE:
+        return;
+    case ACTION_PROCESS:
+        // The run continues in the background; stay in this menu
+        processCDRdata(conn, s->user_output_dir);
+        break;
+    case ACTION_FOLLOW_JOB:
+        if (follow_billing_job(conn, s->user_output_dir, strtoul(s->arg, NULL, 10)) < 0)
+            send_error(conn, "No such billing job.");
+        break;
+    case ACTION_SEARCH_MSISDN: {
+        // Answer from the resident result, else scan the user's CB.txt
+        long msisdn = atol(s->arg);
+        BillingResult *result = result_store_acquire(s->user_output_dir);
+        if (result) {
+            search_msisdn_table(conn, &result->customers, &result->operators, msisdn);
+            result_store_release(result);
+        } else {
+            snprintf(path, sizeof(path), "%s/CB.txt", s->user_output_dir);
+            search_msisdn(conn, path, msisdn);
+        }
+        finish_operation(s);
+        break;
+    }
+    case ACTION_BATCH_MSISDN: {
+        // One probe per MSISDN in memory, else one pass over CB.txt or its index
+        BillingResult *result = result_store_acquire(s->user_output_dir);
+        if (result) {
+            search_msisdn_batch_table(conn, &result->customers, &result->operators,
+                                      s->batch, s->batch_count);
+            result_store_release(result);
+        } else {
+            snprintf(path, sizeof(path), "%s/CB.txt", s->user_output_dir);
+            search_msisdn_batch(conn, path, s->batch, s->batch_count);
+        }
+        clear_batch(s);
+        finish_operation(s);
+        break;
+    }
+    case ACTION_DISPLAY_CB:
+        snprintf(path, sizeof(path), "%s/CB.txt", s->user_output_dir);
+        display_customer_billing_file(conn, path);
+        finish_operation(s);
+        break;
+    case ACTION_SEARCH_OPERATOR: {
+        // Answer from the resident result, else scan the user's IOSB.txt
+        BillingResult *result = result_store_acquire(s->user_output_dir);
+        if (result) {
+            search_operator_table(conn, &result->operators, &result->op_index, s->arg);
+            result_store_release(result);
+        } else {
+            snprintf(path, sizeof(path), "%s/IOSB.txt", s->user_output_dir);
+            search_operator(conn, path, s->arg);
+        }
+        finish_operation(s);
+        break;
+    }
+    case ACTION_DISPLAY_IOSB:
+        snprintf(path, sizeof(path), "%s/IOSB.txt", s->user_output_dir);
+        display_interoperator_billing_file(conn, path);
+        finish_operation(s);
+        break;
+    }
+
+    if (s->connected) send_menu(s);
+}
@@ -0,0 +1,157 @@
+// transfer.c - Report downloads without user-space copies
+// The file is handed to the socket with sendfile(), so a download runs at
+// disk or network speed instead of through an 8 KiB read/send loop. Clients
+// on slow links can ask for deflate instead; the file is then compressed a
+// chunk at a time as it is sent. In frames mode the same bytes travel as
+// FRAME_DATA payloads between a FRAME_FILE and a FRAME_END.
+#include "../Header/transfer.h"
+
+// Wait until sock can take more data; only needed for non-blocking sockets
+static int wait_writable(int sock)
+{
+    struct pollfd pfd = { .fd = sock, .events = POLLOUT };
+    int rc;
+    do {
+        rc = poll(&pfd, 1, -1);
+    } while (rc < 0 && errno == EINTR);
+    return (rc == 1 && !(pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) ? 0 : -1;
+}
+
+// sendfile() len bytes of fd straight to the socket, resuming partial writes
+static int sendfile_all(int sock, int fd, off_t offset, size_t len)
+{
+    while (len > 0) {
+        size_t chunk = len > TRANSFER_CHUNK ? TRANSFER_CHUNK : len;
+        ssize_t n = sendfile(sock, fd, &offset, chunk);
+        if (n > 0) {
+            len -= (size_t)n;
+        } else if (n == 0) {
+            return -1;              // file shrank underneath us
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (wait_writable(sock) != 0) return -1;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// In frames mode each piece of at most TRANSFER_FRAME_CHUNK bytes gets a
+// header of the given type; its payload still goes out through sendfile()
+static int send_file_frames(Conn *conn, int type, int fd, off_t offset, size_t len)
+{
+    do {
+        size_t piece = conn->framed && len > TRANSFER_FRAME_CHUNK ? TRANSFER_FRAME_CHUNK : len;
+        if (conn->framed && conn_frame_header(conn, type, piece) != 0) return -1;
+        // Queued replies go first
+        if (conn_flush(conn) != 0 || sendfile_all(conn->fd, fd, offset, piece) != 0)
+            return -1;
+        offset += (off_t)piece;
+        len -= piece;
+    } while (len > 0);
+    return 0;
+}
+
+int send_file_range(Conn *conn, int fd, off_t offset, size_t len)
+{
+    return send_file_frames(conn, FRAME_TEXT, fd, offset, len);
+}
+
+// One piece of compressed output: a FRAME_DATA, or a FILE_CHUNK line and data
+static int send_deflated_piece(Conn *conn, const void *buf, size_t len)
+{
+    if (conn->framed) return conn_write_frame(conn, FRAME_DATA, buf, len);
+    if (send_linef(conn, "FILE_CHUNK:%zu", len) != 0) return -1;
+    return conn_write(conn, buf, len);
+}
+
+// Stream len bytes of fd as one zlib stream, each piece framed by its length
+static int send_file_deflated(Conn *conn, int fd, size_t len)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit(&zs, TRANSFER_DEFLATE_LEVEL) != Z_OK) return -1;
+
+    unsigned char *in = (unsigned char *)malloc(TRANSFER_DEFLATE_CHUNK);
+    unsigned char *out = (unsigned char *)malloc(TRANSFER_DEFLATE_CHUNK);
+    int rc = in && out ? 0 : -1;
+    int ret = Z_OK;
+    while (rc == 0 && ret != Z_STREAM_END) {
+        size_t want = len > TRANSFER_DEFLATE_CHUNK ? TRANSFER_DEFLATE_CHUNK : len;
+        ssize_t n = want ? read(fd, in, want) : 0;
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 || (want > 0 && n == 0)) {
+            rc = -1;                // unreadable, or the file shrank
+            break;
+        }
+        len -= (size_t)n;
+        zs.next_in = in;
+        zs.avail_in = (uInt)n;
+        int flush = len == 0 ? Z_FINISH : Z_NO_FLUSH;
+
+        // Whatever this step produced goes out now; nothing accumulates
+        do {
+            zs.next_out = out;
+            zs.avail_out = TRANSFER_DEFLATE_CHUNK;
+            ret = deflate(&zs, flush);
+            size_t have = TRANSFER_DEFLATE_CHUNK - zs.avail_out;
+            if (have > 0 && send_deflated_piece(conn, out, have) != 0) rc = -1;
+        } while (rc == 0 && zs.avail_out == 0);
+    }
+    // In frames mode FRAME_END closes the stream instead
+    if (rc == 0 && !conn->framed) rc = send_line(conn, "FILE_CHUNK:0");
+
+    deflateEnd(&zs);
+    free(in);
+    free(out);
+    return rc;
+}
+
+int send_report_file(Conn *conn, const char *path, const char *name)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // SO_SNDBUF stays untouched: setting it would pin the session's buffer
+    // and turn off autotuning, which grows it to tcp_wmem for bulk sends.
+
+    // Hold the header lines back so they leave in the same segment as the data
+    int sock = conn->fd;
+    int on = 1, off = 0;
+    setsockopt(sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+
+    int deflated = (conn->caps & CONN_CAP_DEFLATE) != 0;
+    int sent;
+    if (conn->framed) {
+        char info[CONN_LINE_MAX];
+        int n = snprintf(info, sizeof(info), "%s\n%ld\n%s", name, (long)st.st_size,
+                         deflated ? "deflate" : "identity");
+        conn_write_frame(conn, FRAME_FILE, info, (size_t)n);
+        sent = deflated ? send_file_deflated(conn, fd, (size_t)st.st_size)
+                        : send_file_frames(conn, FRAME_DATA, fd, 0, (size_t)st.st_size);
+        if (sent == 0) sent = conn_write_frame(conn, FRAME_END, NULL, 0);
+    } else {
+        send_linef(conn, "FILE_TRANSFER_START:%s", name);
+        if (deflated) send_line(conn, "FILE_ENCODING:deflate");
+        send_linef(conn, "FILE_SIZE:%ld", (long)st.st_size);
+        sent = deflated ? send_file_deflated(conn, fd, (size_t)st.st_size)
+                        : send_file_range(conn, fd, 0, (size_t)st.st_size);
+        if (sent == 0) sent = send_line(conn, "FILE_TRANSFER_COMPLETE");
+    }
+    int rc = sent == 0 ? 0 : -2;
+
+    setsockopt(sock, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    close(fd);
+    return rc;
+}
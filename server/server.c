@@ -1,42 +1,8 @@
 // server.c - simple TCP menu-driven server
-// Compile on Linux: gcc -o server server.c Auth/auth.c Process/process.c Process/CustBillProcess.c Process/IntopBillProcess.c Billing/CustomerBilling.c Billing/InteroperatorBilling.c -lpthread
+// Compile on Linux: gcc -o server server.c Config/config.c Process/conn.c Process/session.c Process/eventloop.c Auth/auth.c Process/process.c Process/outfile.c Process/arena.c Process/CdrIngest.c Process/CdrCache.c Process/Snapshot.c Process/ResultStore.c Process/ResultCache.c Process/transfer.c Process/CustBillProcess.c Process/IntopBillProcess.c Billing/CustomerBilling.c Billing/InteroperatorBilling.c -lpthread -lz
 
 #include "Header/server.h"
 
-/* ============================================================
-   Socket Communication Helpers
-   ============================================================ */
-
-int sendall(int sock, const char *buf, size_t len) {
-    size_t total = 0;
-    while (total < len) {
-        ssize_t n = send(sock, buf + total, len - total, 0);
-        if (n <= 0) return -1;
-        total += n;
-    }
-    return 0;
-}
-
-int send_line(int sock, const char *s) {
-    char tmp[BUFSIZE];
-    snprintf(tmp, sizeof(tmp), "%s\n", s);
-    return sendall(sock, tmp, strlen(tmp));
-}
-
-ssize_t recv_line(int sock, char *buf, size_t bufsize) {
-    size_t idx = 0;
-    while (idx + 1 < bufsize) {
-        char c;
-        ssize_t r = recv(sock, &c, 1, 0);
-        if (r <= 0) return -1; // closed or error
-        if (c == '\n') break;
-        if (c == '\r') continue;
-        buf[idx++] = c;
-    }
-    buf[idx] = '\0';
-    return (ssize_t)idx;
-}
-
 /* ============================================================
    Client Thread Handling
    ============================================================ */
@@ -59,217 +25,22 @@ void* client_thread(void* arg) {
 }
 
 /* ============================================================
-   Client Request Handler (State Machine)
+   Client Request Handler
    ============================================================ */
 
+// Thread-per-connection mode: block for each line and run actions inline
 void handle_client(int client_fd) {
-    char buf[BUFSIZE];
-    MenuState state = MAIN;
-    int connected = 1;
-    char logged_in_user[EMAIL_MAX] = {0}; // Track logged-in user email
-    char user_output_dir[256] = {0}; // User-specific output directory
-
-    while (connected) {
-        if (state == MAIN) {
-            send_line(client_fd, "-- MAIN MENU --");
-            send_line(client_fd, "1) Signup");
-            send_line(client_fd, "2) Login");
-            send_line(client_fd, "3) Exit");
-            send_line(client_fd, "Enter choice (1-3):");
-            if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-            if (strcmp(buf, "1") == 0) {  // Signup
-                // Request email
-                send_line(client_fd, "Enter email:");
-                if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-                
-                // Validate email
-                if (!is_valid_email(buf)) {
-                    send_line(client_fd, "Invalid email format. Returning to main menu.");
-                    continue;
-                }
-                char email[EMAIL_MAX];
-                strncpy(email, buf, EMAIL_MAX-1);
-                email[EMAIL_MAX-1] = '\0';
-                
-                // Request password
-                send_line(client_fd, "Enter password (min 6 chars, must include: uppercase, lowercase, digit, special char):");
-                if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-                
-                // Validate password (strong validation from auth module)
-                if (!is_valid_password(buf)) {
-                    send_line(client_fd, "Invalid password. Must be at least 6 characters with uppercase, lowercase, digit, and special character. Returning to main menu.");
-                    continue;
-                }
-                
-                // Save user (auth module checks for duplicates)
-                int result = save_user(email, buf);
-                if (result == 1) {
-                    send_line(client_fd, "Signup successful! Please login.");
-                } else if (result == -1) {
-                    send_line(client_fd, "Email already registered. Please login or use a different email.");
-                } else {
-                    send_line(client_fd, "Error creating account. Please try again.");
-                }
-            } else if (strcmp(buf, "2") == 0) {  // Login
-                // Request email
-                send_line(client_fd, "Enter email:");
-                if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-
-                // Validate email
-                if (!is_valid_email(buf)) {
-                    send_line(client_fd, "Invalid email format. Returning to main menu.");
-                    continue;
-                }
-                char email[EMAIL_MAX];
-                strncpy(email, buf, EMAIL_MAX-1);
-                email[EMAIL_MAX-1] = '\0';
-
-                // Request password
-                send_line(client_fd, "Enter password:");
-                if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-
-                // Verify credentials
-                if (verify_user(email, buf)) {
-                    // Store logged-in user email
-                    strncpy(logged_in_user, email, EMAIL_MAX-1);
-                    logged_in_user[EMAIL_MAX-1] = '\0';
-                    
-                    // Create user-specific output directory: Output/<sanitized_email>/
-                    char sanitized[EMAIL_MAX];
-                    strncpy(sanitized, email, EMAIL_MAX-1);
-                    sanitized[EMAIL_MAX-1] = '\0';
-                    // Replace @ and . with _ for safe directory name
-                    for (int i = 0; sanitized[i]; i++) {
-                        if (sanitized[i] == '@' || sanitized[i] == '.') {
-                            sanitized[i] = '_';
-                        }
-                    }
-                    snprintf(user_output_dir, sizeof(user_output_dir), "Output/%s", sanitized);
-                    
-                    // Create the directory (mkdir returns 0 on success, -1 if exists or error)
-                    mkdir(user_output_dir, 0755);
-                    
-                    send_line(client_fd, "Login successful. Welcome!");
-                    state = SECOND;
-                } else {
-                    send_line(client_fd, "Invalid credentials. Returning to main menu.");
-                }
-            } else if (strcmp(buf, "3") == 0) {
-                send_line(client_fd, "Goodbye. Closing connection.");
-                break;
-            } else {
-                send_line(client_fd, "Invalid choice. Try again.");
-            }
-        } else if (state == SECOND) {
-            send_line(client_fd, "-- SECONDARY MENU --");
-            send_line(client_fd, "1) Process the CDR data");
-            send_line(client_fd, "2) Print and search");
-            send_line(client_fd, "3) Logout");
-            send_line(client_fd, "Enter choice (1-3):");
-            if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-            if (strcmp(buf, "1") == 0) {
-                // Process the CDR data: run two worker functions concurrently
-                // processCDRdata will send progress/completion messages to client
-                processCDRdata(client_fd, user_output_dir);
-                // remain in SECOND menu
-            } else if (strcmp(buf, "2") == 0) {
-                state = BILLING;
-            } else if (strcmp(buf, "3") == 0) {
-                state = MAIN; // back to main menu
-            } else {
-                send_line(client_fd, "Invalid choice. Try again.");
-            }
-        } else if (state == BILLING) {
-            send_line(client_fd, "-- PRINT & SEARCH MENU --");
-            send_line(client_fd, "1) Customer Billing");
-            send_line(client_fd, "2) Interoperator Billing");
-            send_line(client_fd, "3) Back");
-            send_line(client_fd, "Enter choice (1-3):");
-            if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-            if (strcmp(buf, "1") == 0) {
-                state = CUST_BILL;
-            } else if (strcmp(buf, "2") == 0) {
-                state = INTER_BILL;
-            } else if (strcmp(buf, "3") == 0) {
-                state = SECOND;
-            } else {
-                send_line(client_fd, "Invalid choice. Try again.");
-            }
-        } else if (state == CUST_BILL) {
-            send_line(client_fd, "-- CUSTOMER BILLING --");
-            send_line(client_fd, "1) Search by msisdn no");
-            send_line(client_fd, "2) Print file content of CB.txt");
-            send_line(client_fd, "3) Back");
-            send_line(client_fd, "Enter choice (1-3):");
-            if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-            if (strcmp(buf, "1") == 0) {
-                // Search by MSISDN
-                send_line(client_fd, "Enter MSISDN to search:");
-                if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-                
-                long msisdn = atol(buf);
-                if (msisdn <= 0) {
-                    send_line(client_fd, "Invalid MSISDN. Please enter a valid number.");
-                } else {
-                    // Use user-specific CB.txt file
-                    char cb_path[300];
-                    snprintf(cb_path, sizeof(cb_path), "%s/CB.txt", user_output_dir);
-                    search_msisdn(client_fd, cb_path, msisdn);
-                }
-                // After search, disconnect client as per requirement
-                send_line(client_fd, "Operation completed. Disconnecting...");
-                connected = 0; // disconnect client, server continues
-            } else if (strcmp(buf, "2") == 0) {
-                // Display CB.txt content
-                char cb_path[300];
-                snprintf(cb_path, sizeof(cb_path), "%s/CB.txt", user_output_dir);
-                display_customer_billing_file(client_fd, cb_path);
-                // After displaying, disconnect client as per requirement
-                send_line(client_fd, "Operation completed. Disconnecting...");
-                connected = 0; // disconnect client, server continues
-            } else if (strcmp(buf, "3") == 0) {
-                state = BILLING;
-            } else {
-                send_line(client_fd, "Invalid choice. Try again.");
-            }
-        } else if (state == INTER_BILL) {
-            send_line(client_fd, "-- INTEROP BILLING --");
-            send_line(client_fd, "1) Search by operator name");
-            send_line(client_fd, "2) Print file content of IOSB.txt");
-            send_line(client_fd, "3) Back");
-            send_line(client_fd, "Enter choice (1-3):");
-            if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-            if (strcmp(buf, "1") == 0) {
-                // Search by operator name
-                send_line(client_fd, "Enter operator name to search:");
-                if (recv_line(client_fd, buf, sizeof(buf)) <= 0) break;
-                
-                if (strlen(buf) == 0) {
-                    send_line(client_fd, "Invalid operator name. Please enter a valid name.");
-                } else {
-                    // Use user-specific IOSB.txt file
-                    char iosb_path[300];
-                    snprintf(iosb_path, sizeof(iosb_path), "%s/IOSB.txt", user_output_dir);
-                    search_operator(client_fd, iosb_path, buf);
-                }
-                // After search, disconnect client as per requirement
-                send_line(client_fd, "Operation completed. Disconnecting...");
-                connected = 0; // disconnect client, server continues
-            } else if (strcmp(buf, "2") == 0) {
-                // Display IOSB.txt content
-                char iosb_path[300];
-                snprintf(iosb_path, sizeof(iosb_path), "%s/IOSB.txt", user_output_dir);
-                display_interoperator_billing_file(client_fd, iosb_path);
-                // After displaying, disconnect client as per requirement
-                send_line(client_fd, "Operation completed. Disconnecting...");
-                connected = 0; // disconnect client, server continues
-            } else if (strcmp(buf, "3") == 0) {
-                state = BILLING;
-            } else {
-                send_line(client_fd, "Invalid choice. Try again.");
-            }
-        }
+    char buf[SESSION_INPUT_MAX];
+    Session session;
+    session_init(&session, client_fd);
+
+    while (session.connected) {
+        if (recv_line(&session.conn, buf, sizeof(buf)) < 0) break;
+        session_input(&session, buf);
+        if (session.action != ACTION_NONE) session_run_action(&session);
     }
+    conn_flush(&session.conn);
+    session_destroy(&session);
     close(client_fd);
 }
 
@@ -311,6 +82,21 @@ int main(void) {
         return 1;
     }
 
+    // Warm start: results of earlier runs are searchable right away
+    int warm = result_store_warm_start(RESULT_OUTPUT_ROOT);
+    printf("Loaded %d billing snapshot(s) from %s/\n", warm, RESULT_OUTPUT_ROOT);
+
+    // Event mode multiplexes sessions on a few epoll threads
+    int event_loops = (int)config_long(CFG_EVENT_LOOPS, 0);
+    if (event_loops > 0) {
+        int workers = (int)config_long(CFG_EVENT_WORKERS, config_online_cpus());
+        if (event_server_start(event_loops, workers > 0 ? workers : 1) != 0) {
+            close(sockfd);
+            return 1;
+        }
+        printf("Event mode: %d loop thread(s), %d worker(s)\n", event_loops, workers > 0 ? workers : 1);
+    }
+
     printf("Server listening on port %d...\n", PORT);
 
     while (1) {
@@ -320,7 +106,12 @@ int main(void) {
             continue;
         }
         printf("Connection from %s\n", inet_ntoa(client_addr.sin_addr));
-        
+        if (event_loops > 0) {
+            event_server_add(client_fd);
+            continue;
+        }
+
+
         // Allocate memory for client info
         ClientInfo *info = (ClientInfo *)malloc(sizeof(ClientInfo));
         if (!info) {